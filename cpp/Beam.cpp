@@ -1,220 +1,335 @@
 #include "Beam.hpp"
+#include "BeamArena.hpp"
+#include "DecodeStats.hpp"
 #include <cassert>
 #include <algorithm>
-#include <math.h>
+#include <cstdlib>
 #include <iostream>
 
 
-Beam::Beam(const std::shared_ptr<LanguageModel>& lm, bool useNGrams, bool forcastNGrams, bool sampleNGrams)
-:m_lm(lm)
-,m_useNGrams(useNGrams)
-,m_forcastNGrams(forcastNGrams)
-,m_sampleNGrams(sampleNGrams)
+std::vector<uint32_t> Beam::getText() const
 {
+	// walk from the last node to the root and fill text from back to front
+	std::vector<uint32_t> res(getTextLength());
+	for (const TextNode* node = m_text; node; node = node->parent)
+	{
+		res[node->length - 1] = node->label;
+	}
+	return res;
 }
 
 
-const std::vector<uint32_t>& Beam::getText() const
+void Beam::appendChar(uint32_t c)
 {
-	return m_text;
+	// the new node takes over the reference of this beam to the old node
+	m_text = m_arena->createTextNode(m_text, c);
 }
 
 
-std::vector<uint32_t> Beam::getNextChars() const
+void Beam::appendWord(uint32_t wordId)
 {
-	return m_lm->getNextChars(m_wordDev);
+	m_wordHist = m_arena->createWordNode(m_wordHist, wordId);
 }
 
 
-std::pair<double, std::vector<std::vector<uint32_t>>> Beam::getNextWordsSampled(const std::shared_ptr<LanguageModel>& lm, const std::vector<uint32_t>& text) const
+void Beam::getNextChars(std::vector<uint32_t>& res) const
 {
-	const size_t maxSampleSize = 20;
-	auto nextWords=lm->getNextWords(text);
-
-	// if sampling not enabled or sampling not needed (too few words), then return all words
-	if (!m_sampleNGrams || nextWords.size()<maxSampleSize)
-	{
-		return std::make_pair(1.0, nextWords);
-	}
-
-	// take random sample, adjust factor which is used to correct N-gram probability
-	const double factor = double(nextWords.size())/double(maxSampleSize);
-	std::random_shuffle(nextWords.begin(), nextWords.end());
-	nextWords.resize(maxSampleSize);
-	return std::make_pair(factor, nextWords);
+	WBS_STATS_ADD(trieWalks, 1);
+	m_lm->getNextChars(m_wordNode, res);
 }
 
 
-void Beam::handleNGrams(std::shared_ptr<Beam>& newBeam, uint32_t newChar) const
+template<LanguageModelType lmType>
+void Beam::handleNGrams(Beam* newBeam, uint32_t newChar) const
 {
-	const auto& wordChars(newBeam->m_lm->getWordChars());
+	// scoring mode is known at compile time, so the branches below are resolved by the compiler
+	const bool forcastNGrams = lmType == LanguageModelType::NGramsForecast || lmType == LanguageModelType::NGramsForecastAndSample;
+	const bool sampleNGrams = lmType == LanguageModelType::NGramsForecastAndSample;
 
 	// char occurs inside a word
-	if (wordChars.find(newChar) != wordChars.end())
+	if (m_lm->isWordChar(newChar))
 	{
-		newBeam->m_wordDev.push_back(newChar);
+		newBeam->m_wordDevLength++;
+		newBeam->m_wordNode = m_lm->getChildNode(m_wordNode, newChar);
+		WBS_STATS_ADD(trieWalks, 1);
 		
 		// get next words, possibly sampled
-		if(m_forcastNGrams)
+		if(forcastNGrams)
 		{
-			std::vector<std::vector<uint32_t>> nextWords;
-			double sampleFactor = 1.0;
-			std::tie(sampleFactor, nextWords) = getNextWordsSampled(newBeam->m_lm, newBeam->m_wordDev);
-		
-			// sum over all unigram/bigram probabilities
-			const size_t numWords = newBeam->m_wordHist.size();
+			// unigram/bigram probability of a word given by its id
+			const size_t numWords = newBeam->getNumWords();
+			const auto getProb = [&](uint32_t wordId)
+			{
+				return numWords == 0 ? m_lm->getUnigramProb(wordId) : m_lm->getBigramProb(newBeam->m_wordHist->wordId, wordId);
+			};
+
+			// sum over all next words, or over a random sample of them if sampling is enabled and there are too many words
+			const size_t maxSampleSize = 20;
+			const auto nextWordIds = m_lm->getNextWordIds(newBeam->m_wordNode);
+			const uint32_t numNextWords = nextWordIds.second - nextWordIds.first;
+			WBS_STATS_ADD(nextWordsCalls, 1);
 			double sum = 0.0;
-			if (numWords == 0)
+			double sampleFactor = 1.0;
+			if (!sampleNGrams || numNextWords < maxSampleSize)
 			{
-				for (const auto& w : nextWords)
-				{
-					sum += newBeam->m_lm->getUnigramProb(w);
-				}
+				// probability mass of the next words is precomputed by the LM
+				sum = numWords == 0 ? m_lm->getNextWordsUnigramProb(newBeam->m_wordNode) : m_lm->getNextWordsBigramProb(newBeam->m_wordHist->wordId, newBeam->m_wordNode);
+				WBS_STATS_ADD(lmLookups, 1);
 			}
 			else
 			{
-				const auto& lastWord = newBeam->m_wordHist.back();
-				for (const auto& w : nextWords)
+				// draw distinct words (Floyd's algorithm), adjust factor which is used to correct N-gram probability
+				sampleFactor = double(numNextWords) / double(maxSampleSize);
+				uint32_t sample[maxSampleSize];
+				size_t sampleSize = 0;
+				for (uint32_t j = numNextWords - maxSampleSize; j < numNextWords; ++j)
 				{
-					sum += newBeam->m_lm->getBigramProb(lastWord, w);
+					uint32_t r = static_cast<uint32_t>(std::rand() % (j + 1));
+					if (std::find(sample, sample + sampleSize, r) != sample + sampleSize)
+					{
+						r = j;
+					}
+					sample[sampleSize++] = r;
+					sum += getProb(nextWordIds.first + r);
 				}
+				WBS_STATS_ADD(nextWordsEnumerated, maxSampleSize);
+				WBS_STATS_ADD(lmLookups, maxSampleSize);
 			}
 
 			// correct sampling 
 			sum = std::min(sum*sampleFactor, 1.0);
 
 			// set calculated probability
-			newBeam->m_prTextTotal = newBeam->m_prTextUnnormalized*sum;
-			newBeam->m_prTextTotal = numWords >= 1 ? pow(newBeam->m_prTextTotal, 1.0 / (numWords + 1)) : newBeam->m_prTextTotal;
+			newBeam->m_prTextTotal = m_domain.root(m_domain.mul(newBeam->m_prTextUnnormalized, m_domain.fromProb(sum)), numWords + 1);
 		}
 	}
 	else
 	{
 		// current word not empty
-		if (!newBeam->m_wordDev.empty())
+		if (newBeam->m_wordDevLength != 0)
 		{
-			newBeam->m_wordHist.push_back(newBeam->m_wordDev);
-			newBeam->m_wordDev.clear();
-
-			const size_t numWords = newBeam->m_wordHist.size();
-			if (numWords == 1)
-			{
-				newBeam->m_prTextUnnormalized *= newBeam->m_lm->getUnigramProb(newBeam->m_wordHist.back());
-				newBeam->m_prTextTotal = newBeam->m_prTextUnnormalized;
-			}
-			else if (numWords >= 2)
-			{
-				newBeam->m_prTextUnnormalized *= newBeam->m_lm->getBigramProb(*(newBeam->m_wordHist.end() - 2), *(newBeam->m_wordHist.end() - 1));
-				newBeam->m_prTextTotal = pow(newBeam->m_prTextUnnormalized, 1.0 / numWords);
-			}
+			newBeam->appendWord(m_lm->getWordId(newBeam->m_wordNode));
+			newBeam->m_wordDevLength = 0;
+			newBeam->m_wordNode = m_lm->getRootNode();
+
+			const size_t numWords = newBeam->getNumWords();
+			const double prWord = numWords == 1 ? m_lm->getUnigramProb(newBeam->m_wordHist->wordId) : m_lm->getBigramProb(newBeam->m_wordHist->parent->wordId, newBeam->m_wordHist->wordId);
+			WBS_STATS_ADD(lmLookups, 1);
+			newBeam->m_prTextUnnormalized = m_domain.mul(newBeam->m_prTextUnnormalized, m_domain.fromProb(prWord));
+			newBeam->m_prTextTotal = m_domain.root(newBeam->m_prTextUnnormalized, numWords);
 		}
 
 	}
 }
 
 
-std::shared_ptr<Beam> Beam::createChildBeam(double prBlank, double prNonBlank, uint32_t newChar) const
+Beam* Beam::createChildBeam(double prBlank, double prNonBlank) const
 {
-	// copy this beam
-	std::shared_ptr<Beam> newBeam = std::make_shared<Beam>(*this);
+	// copy this beam, text and word history are shared with this beam
+	Beam* newBeam = m_arena->copyBeam(*this);
+	WBS_STATS_ADD(candidates, 1);
+	newBeam->m_prBlank = prBlank;
+	newBeam->m_prNonBlank = prNonBlank;
+	return newBeam;
+}
+
 
-	// add new char to text and assign calculated probabilities
-	if (newChar != std::numeric_limits<uint32_t>::max())
+template<LanguageModelType lmType>
+Beam* Beam::createChildBeam(double prBlank, double prNonBlank, uint32_t newChar) const
+{
+	Beam* newBeam = createChildBeam(prBlank, prNonBlank);
+
+	// score text by N-grams, or only track the current word in the prefix tree
+	if (lmType != LanguageModelType::Words)
+	{
+		WBS_STATS_TIMER(lmTimer, lmTime);
+		handleNGrams<lmType>(newBeam, newChar);
+	}
+	else
 	{
-		if (m_useNGrams)
+		if (m_lm->isWordChar(newChar))
 		{
-			handleNGrams(newBeam, newChar);
+			newBeam->m_wordDevLength++;
+			newBeam->m_wordNode = m_lm->getChildNode(m_wordNode, newChar);
+			WBS_STATS_ADD(trieWalks, 1);
 		}
 		else
 		{
-			const auto& wordChars(newBeam->m_lm->getWordChars());
-			if (wordChars.find(newChar) != wordChars.end())
-			{
-				newBeam->m_wordDev.push_back(newChar);
-			}
-			else
-			{
-				newBeam->m_wordDev.clear();
-			}
+			newBeam->m_wordDevLength = 0;
+			newBeam->m_wordNode = m_lm->getRootNode();
 		}
-		
-		// always append new char to text of beam
-		newBeam->m_text.push_back(newChar);
 	}
-	
-	newBeam->m_prBlank = prBlank;
-	newBeam->m_prNonBlank = prNonBlank;
+
+	// always append new char to text of beam
+	newBeam->appendChar(newChar);
 	return newBeam;
 }
 
 
-void Beam::mergeBeam(const std::shared_ptr<Beam>& beam)
+// child beams are compiled for each scoring mode
+template Beam* Beam::createChildBeam<LanguageModelType::Words>(double prBlank, double prNonBlank, uint32_t newChar) const;
+template Beam* Beam::createChildBeam<LanguageModelType::NGrams>(double prBlank, double prNonBlank, uint32_t newChar) const;
+template Beam* Beam::createChildBeam<LanguageModelType::NGramsForecast>(double prBlank, double prNonBlank, uint32_t newChar) const;
+template Beam* Beam::createChildBeam<LanguageModelType::NGramsForecastAndSample>(double prBlank, double prNonBlank, uint32_t newChar) const;
+
+
+void Beam::mergeBeam(const Beam& beam)
 {
-	assert(getText() == beam->getText());
+	assert(TextNodeEqual()(getTextNode(), beam.getTextNode()));
 	
 	// sum up probabilities
-	m_prBlank += beam->m_prBlank;
-	m_prNonBlank += beam->m_prNonBlank;
+	m_prBlank = m_domain.add(m_prBlank, beam.m_prBlank);
+	m_prNonBlank = m_domain.add(m_prNonBlank, beam.m_prNonBlank);
 }
 
 
 void Beam::completeText()
 {
 	// nothing to do if beam has no unfinished words at the end
-	if (m_wordDev.empty())
+	if (m_wordDevLength == 0)
 	{
 		return;
 	}
 
 	// get next words
-	const auto nextWords=m_lm->getNextWords(m_wordDev);
+	const auto nextWordIds = m_lm->getNextWordIds(m_wordNode);
 
 	// if only one next word possible, then take this word and complete beam with it
-	if (nextWords.size() == 1)
+	if (nextWordIds.second - nextWordIds.first == 1)
 	{
-		assert(m_text.size()>=m_wordDev.size());
-		const auto& completeWord = nextWords[0];
-		m_text.resize(m_text.size() - m_wordDev.size());
-		m_text.insert(m_text.end(), completeWord.begin(), completeWord.end());
+		assert(getTextLength()>=m_wordDevLength);
+		const auto completeWord = m_lm->getWordLabels(nextWordIds.first);
+		const TextNode* node = m_text;
+		for (size_t i = 0; i < m_wordDevLength; ++i)
+		{
+			node = node->parent;
+		}
+		m_arena->acquire(node);
+		m_arena->release(m_text);
+		m_text = node;
+		for (const uint32_t* c = completeWord.first; c != completeWord.second; ++c)
+		{
+			appendChar(*c);
+		}
 	}
 	
 }
 
 
-void BeamList::addBeam(const std::shared_ptr<Beam>& beam)
+BeamList::BeamList(BeamArena& arena)
+:m_arena(&arena)
+{
+}
+
+
+BeamList::~BeamList()
+{
+	clear();
+}
+
+
+size_t BeamList::getSlot(const TextNode* text) const
 {
-	// if beam text already in list, merge beams, otherwise add new beam
-	auto iter=m_beams.find(beam->getText());
-	if (iter == m_beams.end())
+	// Fibonacci hashing: take the upper bits of the scrambled hash
+	return static_cast<size_t>((TextNodeHash()(text) * 0x9e3779b97f4a7c15ull) >> (64 - m_tableBits));
+}
+
+
+void BeamList::resizeTable(size_t tableBits)
+{
+	m_tableBits = tableBits;
+	m_table.assign(size_t(1) << m_tableBits, 0);
+	const size_t mask = m_table.size() - 1;
+	for (size_t i = 0; i < m_beams.size(); ++i)
 	{
-		m_beams[beam->getText()] = beam;
+		size_t slot = getSlot(m_beams[i]->getTextNode());
+		while (m_table[slot] != 0)
+		{
+			slot = (slot + 1) & mask;
+		}
+		m_table[slot] = static_cast<uint32_t>(i + 1);
 	}
-	else
+}
+
+
+void BeamList::addBeam(Beam* beam)
+{
+	// keep load factor of hash table below 0.5
+	if (2 * (m_beams.size() + 1) > m_table.size())
 	{
-		iter->second->mergeBeam(beam);
+		resizeTable(std::max(m_tableBits + 1, size_t(6)));
+	}
+
+	// search beam text: if already in list, merge beams, otherwise add new beam
+	const TextNodeEqual isEqual;
+	const size_t mask = m_table.size() - 1;
+	size_t slot = getSlot(beam->getTextNode());
+	while (m_table[slot] != 0)
+	{
+		Beam* other = m_beams[m_table[slot] - 1];
+		if (isEqual(other->getTextNode(), beam->getTextNode()))
+		{
+			other->mergeBeam(*beam);
+			m_arena->releaseBeam(beam);
+			WBS_STATS_ADD(merges, 1);
+			return;
+		}
+		slot = (slot + 1) & mask;
 	}
+
+	m_table[slot] = static_cast<uint32_t>(m_beams.size() + 1);
+	m_beams.push_back(beam);
 }
 
 
-std::vector<std::shared_ptr<Beam>> BeamList::getBestBeams(size_t beamWidth)
+const std::vector<Beam*>& BeamList::getBestBeams(size_t beamWidth)
 {
-	// sort by totalProb*textualProb
-	typedef std::pair<std::vector<uint32_t>, std::shared_ptr<Beam>> KeyValueType;
-	std::vector<KeyValueType> beams(m_beams.begin(), m_beams.end());
-	std::sort
+	// compute score once per beam
+	typedef std::pair<double, Beam*> ScoreType;
+	m_scores.clear();
+	for (const auto beam : m_beams)
+	{
+		m_scores.push_back(std::make_pair(beam->getScore(), beam));
+	}
+
+	// only the best beams must be sorted
+	const size_t numBest = std::min(beamWidth, m_scores.size());
+	std::partial_sort
 	(
-		beams.begin()
-		,beams.end()
-		,[](const KeyValueType& a, const KeyValueType& b) {return a.second->getTotalProb()*a.second->getTextualProb() > b.second->getTotalProb()*b.second->getTextualProb(); }
+		m_scores.begin()
+		,m_scores.begin() + numBest
+		,m_scores.end()
+		,[](const ScoreType& a, const ScoreType& b) {return a.first > b.first; }
 	);
 
-	// take beam object (take value, ignore key) and return it
-	std::vector<std::shared_ptr<Beam>> res;
-	res.reserve(beamWidth);
-	for (size_t i = 0; i < beams.size() && i < beamWidth; ++i)
+	// take beam objects and return them
+	m_bestBeams.clear();
+	for (size_t i = 0; i < numBest; ++i)
 	{
-		res.push_back(beams[i].second);
+		m_bestBeams.push_back(m_scores[i].second);
 	}
-	return res;
+	return m_bestBeams;
+}
+
+
+void BeamList::clear()
+{
+	for (const auto beam : m_beams)
+	{
+		m_arena->releaseBeam(beam);
+	}
+	m_beams.clear();
+	m_bestBeams.clear();
+	std::fill(m_table.begin(), m_table.end(), 0);
 }
 
+
+void BeamList::swap(BeamList& other)
+{
+	std::swap(m_arena, other.m_arena);
+	m_beams.swap(other.m_beams);
+	m_table.swap(other.m_table);
+	std::swap(m_tableBits, other.m_tableBits);
+	m_scores.swap(other.m_scores);
+	m_bestBeams.swap(other.m_bestBeams);
+}
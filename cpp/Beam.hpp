@@ -1,73 +1,172 @@
 #pragma once
-#include "HashFunction.hpp"
 #include "LanguageModel.hpp"
+#include "ProbDomain.hpp"
 #include <vector>
 #include <memory>
-#include <unordered_map>
 #include <limits>
 #include <stdint.h>
 #include <cstddef>
 
 
+// node of the (immutable) beam text: the text is given by the labels on the path from the root to the node.
+// Child beams share the nodes of their parent beam, so extending a text by a char is O(1).
+// Nodes are owned by a BeamArena and are reference counted by the beams and child nodes using them
+struct TextNode
+{
+	const TextNode* parent = nullptr; // nullptr for the first char of the text
+	uint32_t label = 0;
+	size_t length = 0; // number of chars from the root to this node
+	uint64_t hash = 0; // rolling hash of the text, incrementally computed from the hash of the parent node
+	mutable size_t refCount = 0;
+
+	// hash of the empty text and hash of text extended by given label
+	static uint64_t emptyHash() { return 0x9e3779b97f4a7c15ull; }
+	static uint64_t appendHash(uint64_t hash, uint32_t label) { return hash * 0x100000001b3ull + label + 1; }
+};
+
+
+// hash and equality for beam texts represented by their last node (nullptr for empty text).
+// Equality walks both texts only until the nodes are shared, which happens early for texts from the same ancestor beam
+struct TextNodeHash
+{
+	uint64_t operator()(const TextNode* node) const
+	{
+		return node ? node->hash : TextNode::emptyHash();
+	}
+};
+
+struct TextNodeEqual
+{
+	bool operator()(const TextNode* a, const TextNode* b) const
+	{
+		while (a != b)
+		{
+			if (!a || !b || a->hash != b->hash || a->length != b->length || a->label != b->label)
+			{
+				return false;
+			}
+			a = a->parent;
+			b = b->parent;
+		}
+		return true;
+	}
+};
+
+
+// node of the (immutable) word history of a beam, shared between beams in the same way as TextNode
+struct WordNode
+{
+	const WordNode* parent = nullptr; // nullptr for the first word of the text
+	uint32_t wordId = 0; // word id of the LM
+	size_t numWords = 0; // number of words from the root to this node
+	mutable size_t refCount = 0;
+};
+
+
+class BeamArena;
+
+
 class Beam
 {
 public:
-	// CTOR
-	Beam(const std::shared_ptr<LanguageModel>& lm, bool useNGrams, bool forcastNGrams, bool sampleNGrams);
+	// CTOR: beams are created by BeamArena, use BeamArena::createBeam() to create the first (empty) beam
+	Beam() = default;
+
+	// text of the beam, this is materialized from the text nodes on each call
+	std::vector<uint32_t> getText() const;
+	size_t getTextLength() const { return m_text ? m_text->length : 0; }
+	uint32_t getLastChar() const { return m_text->label; } // only valid if text is not empty
+	const TextNode* getTextNode() const { return m_text; } // identity of text, see TextNodeHash and TextNodeEqual
 
-	// next possible characters and words
-	const std::vector<uint32_t>& getText() const;
-	std::vector<uint32_t> getNextChars() const;
+	// next possible characters (written to res)
+	void getNextChars(std::vector<uint32_t>& res) const;
 
-	// create child beam by extending by given character
-	std::shared_ptr<Beam> createChildBeam(double prBlank, double prNonBlank, uint32_t newChar=std::numeric_limits<uint32_t>::max()) const;
+	// create child beam with the same text, the child is allocated in the arena of this beam
+	Beam* createChildBeam(double prBlank, double prNonBlank) const;
+
+	// create child beam by extending by given character, the text is scored according to the scoring mode of the LM
+	template<LanguageModelType lmType>
+	Beam* createChildBeam(double prBlank, double prNonBlank, uint32_t newChar) const;
 
 	// merge given beam with this beam
-	void mergeBeam(const std::shared_ptr<Beam>& beam);
+	void mergeBeam(const Beam& beam);
 
 	// complete the text (last word) of the beam
 	void completeText();
 
-	// get probabilities of beam
+	// get probabilities of beam (log-probabilities in log-domain)
 	double getBlankProb() const { return m_prBlank; } // optical: paths ending with blank
 	double getNonBlankProb() const { return m_prNonBlank; } // optical: paths ending with non-blank
-	double getTotalProb() const { return m_prBlank + m_prNonBlank; } // optical: total
+	double getTotalProb() const { return m_domain.add(m_prBlank, m_prNonBlank); } // optical: total
 	double getTextualProb() const { return m_prTextTotal; } // textual
+	double getScore() const { return m_domain.mul(getTotalProb(), getTextualProb()); } // optical*textual, used to rank beams
 
 private:
-	std::shared_ptr<LanguageModel> m_lm;
+	// only the arena copies beams, as it has to take care of the reference counts of the nodes
+	friend class BeamArena;
+	Beam(const Beam&) = default;
+	Beam& operator=(const Beam&) = default;
+
+	BeamArena* m_arena = nullptr;
+	const LanguageModel* m_lm = nullptr;
+	ProbDomain m_domain;
 
 	// optical part
 	double m_prBlank = 1.0;
 	double m_prNonBlank = 0.0;
 
 	// textual part
-	std::vector<uint32_t> m_text; // complete text of this beam
-	std::vector<uint32_t> m_wordDev; // currently "built" word
-	std::vector<std::vector<uint32_t>> m_wordHist; // history of words in text
+	const TextNode* m_text = nullptr; // last node of the text of this beam, nullptr for empty text
+	size_t m_wordDevLength = 0; // number of chars of the currently "built" word
+	PrefixTree::NodeId m_wordNode = 0; // node of the prefix tree which represents the currently "built" word
+	const WordNode* m_wordHist = nullptr; // last word of the history of words in text, nullptr if no words
 	double m_prTextTotal = 1.0;
-	double m_prTextUnnormalized = 1.0;
-	bool m_useNGrams = false;
-	bool m_forcastNGrams = false;
-	bool m_sampleNGrams = false;
+	double m_prTextUnnormalized = 1.0; // only used if beam text is scored by N-grams
 
 	// methods to score beam text by LM
-	void handleNGrams(std::shared_ptr<Beam>& newBeam, uint32_t newChar) const;
-	std::pair<double, std::vector<std::vector<uint32_t>>> getNextWordsSampled(const std::shared_ptr<LanguageModel>& lm, const std::vector<uint32_t>& text) const;
+	template<LanguageModelType lmType>
+	void handleNGrams(Beam* newBeam, uint32_t newChar) const;
+	size_t getNumWords() const { return m_wordHist ? m_wordHist->numWords : 0; }
+
+	// append char to text or word to word history by adding a new node
+	void appendChar(uint32_t c);
+	void appendWord(uint32_t wordId);
 };
 
 
-// holds all beams at one time-step
+// holds all beams at one time-step. The list owns its beams, they are released to the arena when the list is cleared
 class BeamList
 {
 public:
-	// add beam to list
-	void addBeam(const std::shared_ptr<Beam>& beam);
+	// CTOR
+	explicit BeamList(BeamArena& arena);
+	~BeamList();
+	BeamList(const BeamList&) = delete;
+	BeamList& operator=(const BeamList&) = delete;
+
+	// add beam to list, the beam is merged into the beam with the same text (and released) if there is one
+	void addBeam(Beam* beam);
+
+	// select best beams according to score (totalProb*textualProb), best beam first.
+	// The result is valid until the list is modified
+	const std::vector<Beam*>& getBestBeams(size_t beamWidth);
 
-	// sort beams according to (totalProb*textualProb) and return best beams
-	std::vector<std::shared_ptr<Beam>> getBestBeams(size_t beamWidth);
+	// release all beams, memory of the list is kept for the next time-step
+	void clear();
+	void swap(BeamList& other);
 
 private:
-	std::unordered_map<std::vector<uint32_t>, std::shared_ptr<Beam>, HashFunction> m_beams;
+	BeamArena* m_arena;
+	std::vector<Beam*> m_beams;
+
+	// open addressing hash table (linear probing) from text to beam: index+1 into m_beams, 0 for empty slots
+	std::vector<uint32_t> m_table;
+	size_t m_tableBits = 0;
+	size_t getSlot(const TextNode* text) const;
+	void resizeTable(size_t tableBits);
+
+	// buffers for selecting best beams
+	std::vector<std::pair<double, Beam*>> m_scores;
+	std::vector<Beam*> m_bestBeams;
 };
 
@@ -0,0 +1,135 @@
+#include "BeamArena.hpp"
+#include <cassert>
+
+
+template<class T>
+T* BeamArena::allocate(Pool<T>& pool)
+{
+	// reuse released object if available
+	if (!pool.freeObjects.empty())
+	{
+		T* obj = pool.freeObjects.back();
+		pool.freeObjects.pop_back();
+		++m_numReuses;
+		return obj;
+	}
+
+	pool.objects.emplace_back();
+	++m_numAllocations;
+	return &pool.objects.back();
+}
+
+
+Beam* BeamArena::createBeam(const LanguageModel& lm, bool logDomain)
+{
+	Beam* beam = allocate(m_beams);
+	beam->m_arena = this;
+	beam->m_lm = &lm;
+	beam->m_domain = ProbDomain(logDomain);
+	beam->m_prBlank = beam->m_domain.one();
+	beam->m_prNonBlank = beam->m_domain.zero();
+	beam->m_text = nullptr;
+	beam->m_wordDevLength = 0;
+	beam->m_wordNode = lm.getRootNode();
+	beam->m_wordHist = nullptr;
+	beam->m_prTextTotal = beam->m_domain.one();
+	beam->m_prTextUnnormalized = beam->m_domain.one();
+	return beam;
+}
+
+
+Beam* BeamArena::copyBeam(const Beam& beam)
+{
+	// the copy shares the text and word history nodes of the beam, so it takes a reference to them
+	Beam* newBeam = allocate(m_beams);
+	*newBeam = beam;
+	acquire(newBeam->m_text);
+	acquire(newBeam->m_wordHist);
+	return newBeam;
+}
+
+
+void BeamArena::releaseBeam(Beam* beam)
+{
+	release(beam->m_text);
+	release(beam->m_wordHist);
+	beam->m_text = nullptr;
+	beam->m_wordHist = nullptr;
+	m_beams.freeObjects.push_back(beam);
+}
+
+
+const TextNode* BeamArena::createTextNode(const TextNode* parent, uint32_t label)
+{
+	TextNode* node = allocate(m_textNodes);
+	node->parent = parent;
+	node->label = label;
+	node->length = parent ? parent->length + 1 : 1;
+	node->hash = TextNode::appendHash(parent ? parent->hash : TextNode::emptyHash(), label);
+	node->refCount = 1;
+	return node;
+}
+
+
+const WordNode* BeamArena::createWordNode(const WordNode* parent, uint32_t wordId)
+{
+	WordNode* node = allocate(m_wordNodes);
+	node->parent = parent;
+	node->wordId = wordId;
+	node->numWords = parent ? parent->numWords + 1 : 1;
+	node->refCount = 1;
+	return node;
+}
+
+
+void BeamArena::acquire(const TextNode* node) const
+{
+	if (node)
+	{
+		++node->refCount;
+	}
+}
+
+
+void BeamArena::acquire(const WordNode* node) const
+{
+	if (node)
+	{
+		++node->refCount;
+	}
+}
+
+
+void BeamArena::release(const TextNode* node)
+{
+	// a released node gives up its reference to the parent node
+	while (node)
+	{
+		assert(node->refCount > 0);
+		if (--node->refCount > 0)
+		{
+			return;
+		}
+
+		const TextNode* parent = node->parent;
+		m_textNodes.freeObjects.push_back(const_cast<TextNode*>(node));
+		node = parent;
+	}
+}
+
+
+void BeamArena::release(const WordNode* node)
+{
+	while (node)
+	{
+		assert(node->refCount > 0);
+		if (--node->refCount > 0)
+		{
+			return;
+		}
+
+		const WordNode* parent = node->parent;
+		m_wordNodes.freeObjects.push_back(const_cast<WordNode*>(node));
+		node = parent;
+	}
+}
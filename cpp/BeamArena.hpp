@@ -0,0 +1,62 @@
+#pragma once
+#include "Beam.hpp"
+#include "LanguageModel.hpp"
+#include <vector>
+#include <deque>
+#include <stdint.h>
+#include <cstddef>
+
+
+// owns beams and the nodes of their texts and word histories.
+// Released objects are kept in free lists and reused, so after the first decoding calls no more memory is allocated.
+// An arena is not thread-safe, use one arena per thread
+class BeamArena
+{
+public:
+	// CTOR
+	BeamArena() = default;
+	BeamArena(const BeamArena&) = delete;
+	BeamArena& operator=(const BeamArena&) = delete;
+
+	// create beam with empty text, probabilities of the beam are log-probabilities if logDomain is set.
+	// The LM must live as long as the beams created from it are used
+	Beam* createBeam(const LanguageModel& lm, bool logDomain = false);
+
+	// copy beam, text and word history are shared between both beams
+	Beam* copyBeam(const Beam& beam);
+
+	// give beam back to the arena
+	void releaseBeam(Beam* beam);
+
+	// create node with a reference count of 1, the reference of the caller to the parent node is moved to the new node
+	const TextNode* createTextNode(const TextNode* parent, uint32_t label);
+	const WordNode* createWordNode(const WordNode* parent, uint32_t wordId);
+
+	// increment/decrement reference count of node, node (and its ancestors) are reused when not referenced anymore
+	void acquire(const TextNode* node) const;
+	void acquire(const WordNode* node) const;
+	void release(const TextNode* node);
+	void release(const WordNode* node);
+
+	// number of objects (beams and nodes) allocated from the heap and number of objects reused from the free lists
+	size_t getNumAllocations() const { return m_numAllocations; }
+	size_t getNumReuses() const { return m_numReuses; }
+
+private:
+	// objects are stored in a deque, which does not move them when growing
+	template<class T>
+	struct Pool
+	{
+		std::deque<T> objects;
+		std::vector<T*> freeObjects;
+	};
+
+	Pool<Beam> m_beams;
+	Pool<TextNode> m_textNodes;
+	Pool<WordNode> m_wordNodes;
+	size_t m_numAllocations = 0;
+	size_t m_numReuses = 0;
+
+	template<class T>
+	T* allocate(Pool<T>& pool);
+};
@@ -0,0 +1,145 @@
+#include "BinaryFile.hpp"
+#include <cstdio>
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile(const std::string& path)
+{
+#ifdef _WIN32
+	// read whole file
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		throw std::runtime_error("can not open file " + path);
+	}
+	m_buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	m_data = m_buffer.data();
+	m_size = m_buffer.size();
+#else
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw std::runtime_error("can not open file " + path);
+	}
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0)
+	{
+		close(fd);
+		throw std::runtime_error("can not query size of file " + path);
+	}
+	m_size = static_cast<size_t>(fileStat.st_size);
+
+	// an empty file can not be mapped, it is handled as a file without data
+	if (m_size > 0)
+	{
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			close(fd);
+			throw std::runtime_error("can not map file " + path);
+		}
+		m_data = static_cast<const char*>(data);
+	}
+
+	// the mapping stays valid after closing the file
+	close(fd);
+#endif
+}
+
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+	if (m_data)
+	{
+		munmap(const_cast<char*>(m_data), m_size);
+	}
+#endif
+}
+
+
+BinaryWriter::BinaryWriter(const std::string& path)
+:m_path(path)
+,m_tmpPath(path + ".tmp")
+,m_file(m_tmpPath, std::ios::binary)
+{
+	if (!m_file)
+	{
+		throw std::runtime_error("can not create file " + m_tmpPath);
+	}
+}
+
+
+BinaryWriter::~BinaryWriter()
+{
+	if (!m_closed)
+	{
+		m_file.close();
+		std::remove(m_tmpPath.c_str());
+	}
+}
+
+
+void BinaryWriter::align()
+{
+	while (m_pos % 8 != 0)
+	{
+		m_file.put(0);
+		++m_pos;
+	}
+}
+
+
+void BinaryWriter::close()
+{
+	m_file.close();
+	if (!m_file)
+	{
+		throw std::runtime_error("can not write file " + m_tmpPath);
+	}
+
+	// the old file is unlinked instead of overwritten, existing mappings keep referring to its data
+#ifdef _WIN32
+	std::remove(m_path.c_str()); // rename does not replace an existing file on Windows
+#endif
+	if (std::rename(m_tmpPath.c_str(), m_path.c_str()) != 0)
+	{
+		throw std::runtime_error("can not replace file " + m_path);
+	}
+	m_closed = true;
+}
+
+
+BinaryReader::BinaryReader(const MappedFile& file)
+:m_begin(file.data())
+,m_pos(file.data())
+,m_end(file.data() + file.size())
+{
+}
+
+
+const char* BinaryReader::take(size_t numBytes)
+{
+	if (numBytes > size_t(m_end - m_pos))
+	{
+		throw std::runtime_error("binary file is corrupt: unexpected end of file");
+	}
+
+	const char* res = m_pos;
+	m_pos += numBytes;
+	return res;
+}
+
+
+void BinaryReader::align()
+{
+	take((8 - (m_pos - m_begin) % 8) % 8);
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "DataArray.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <stdint.h>
+#include <cstddef>
+
+
+// file mapped read-only into memory. Pages are shared between processes mapping the same file.
+// On platforms without mmap the file is read into memory instead
+class MappedFile
+{
+public:
+	// CTOR: throws std::runtime_error if the file can not be mapped
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+	std::vector<char> m_buffer; // only used if mmap is not available
+};
+
+
+// write values and arrays to a binary file. Arrays are stored as element count followed by the elements,
+// both aligned to 8 bytes, so a mapped file can be used without copying the arrays.
+// The data is written to a temporary file which replaces the file at path when closing, so processes still mapping the old file are not affected
+class BinaryWriter
+{
+public:
+	// CTOR: throws std::runtime_error if the file can not be created
+	explicit BinaryWriter(const std::string& path);
+	~BinaryWriter(); // removes the temporary file if close was not called
+	BinaryWriter(const BinaryWriter&) = delete;
+	BinaryWriter& operator=(const BinaryWriter&) = delete;
+
+	template<class T>
+	void writeValue(const T& value)
+	{
+		m_file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		m_pos += sizeof(T);
+	}
+
+	template<class T>
+	void writeArray(const T* data, size_t size)
+	{
+		writeValue(uint64_t(size));
+		align();
+		m_file.write(reinterpret_cast<const char*>(data), size * sizeof(T));
+		m_pos += size * sizeof(T);
+		align();
+	}
+
+	template<class T>
+	void writeArray(const DataArray<T>& array) { writeArray(array.data(), array.size()); }
+	template<class T>
+	void writeArray(const std::vector<T>& array) { writeArray(array.data(), array.size()); }
+
+	// replace the file at path by the written data, throws std::runtime_error if writing failed
+	void close();
+
+private:
+	std::string m_path;
+	std::string m_tmpPath;
+	std::ofstream m_file;
+	bool m_closed = false;
+	size_t m_pos = 0;
+	void align();
+};
+
+
+// read values and arrays written by BinaryWriter from a mapped file, arrays refer to the memory of the file.
+// Throws std::runtime_error if the file is too short
+class BinaryReader
+{
+public:
+	// CTOR
+	explicit BinaryReader(const MappedFile& file);
+
+	template<class T>
+	T readValue()
+	{
+		T value;
+		const char* data = take(sizeof(T));
+		std::copy(data, data + sizeof(T), reinterpret_cast<char*>(&value));
+		return value;
+	}
+
+	template<class T>
+	DataArray<T> readArray()
+	{
+		const uint64_t size = readValue<uint64_t>();
+		align();
+		if (size > (m_end - m_pos) / sizeof(T))
+		{
+			throw std::runtime_error("binary file is corrupt: array exceeds end of file");
+		}
+		const T* data = reinterpret_cast<const T*>(take(size_t(size) * sizeof(T)));
+		align();
+		return DataArray<T>(data, size_t(size));
+	}
+
+private:
+	const char* m_begin;
+	const char* m_pos;
+	const char* m_end;
+	const char* take(size_t numBytes); // advance position, returns old position
+	void align();
+};
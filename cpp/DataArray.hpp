@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+
+// read-only array which either owns its elements or refers to elements stored elsewhere, e.g. in a memory-mapped file.
+// The owner of borrowed elements must live as long as the array is used
+template<class T>
+class DataArray
+{
+public:
+	// CTOR: empty array, array owning the given elements, array borrowing the given elements
+	DataArray() = default;
+	explicit DataArray(std::vector<T>&& elements)
+	:m_elements(std::move(elements))
+	,m_data(m_elements.data())
+	,m_size(m_elements.size())
+	{
+	}
+	DataArray(const T* data, size_t size)
+	:m_data(data)
+	,m_size(size)
+	,m_owned(false)
+	{
+	}
+
+	// copies of an owning array own a copy of the elements
+	DataArray(const DataArray& other)
+	:m_elements(other.m_elements)
+	,m_data(other.m_owned ? m_elements.data() : other.m_data)
+	,m_size(other.m_size)
+	,m_owned(other.m_owned)
+	{
+	}
+	DataArray& operator=(const DataArray& other)
+	{
+		DataArray tmp(other);
+		swap(tmp);
+		return *this;
+	}
+	DataArray(DataArray&& other)
+	{
+		swap(other);
+	}
+	DataArray& operator=(DataArray&& other)
+	{
+		swap(other);
+		return *this;
+	}
+
+	void swap(DataArray& other)
+	{
+		// the data pointer of a vector is not changed when vectors are swapped
+		m_elements.swap(other.m_elements);
+		std::swap(m_data, other.m_data);
+		std::swap(m_size, other.m_size);
+		std::swap(m_owned, other.m_owned);
+	}
+
+	// element access
+	const T& operator[](size_t i) const { return m_data[i]; }
+	const T* data() const { return m_data; }
+	const T* begin() const { return m_data; }
+	const T* end() const { return m_data + m_size; }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	// number of bytes allocated by the array itself, borrowed elements are not counted
+	size_t getMemoryUsage() const { return m_elements.capacity() * sizeof(T); }
+
+private:
+	std::vector<T> m_elements;
+	const T* m_data = nullptr;
+	size_t m_size = 0;
+	bool m_owned = true;
+};
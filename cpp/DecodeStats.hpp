@@ -0,0 +1,105 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+
+
+// counters and timers of the hot path of the decoder, e.g. to find out why one input takes much longer to decode than another.
+// They are only collected if compiled with WBS_STATS, otherwise the WBS_STATS_* macros compile to nothing and all values stay 0.
+// The decoders running on a thread add their statistics to the object passed to DecodeStats::Collect while it exists
+struct DecodeStats
+{
+	size_t timeSteps = 0; // decoded time-steps
+	size_t blankFrames = 0; // time-steps in which no char extended the beams because of the blank threshold
+	size_t beamsExpanded = 0; // best beams which were extended, summed over all time-steps
+	size_t candidates = 0; // child beams created
+	size_t merges = 0; // child beams merged into a beam with the same text by BeamList::addBeam
+	size_t trieWalks = 0; // prefix tree queries: next chars of a beam and child node of a char
+	size_t nextWordsCalls = 0; // queries of the next words of a prefix tree node (forecast)
+	size_t nextWordsEnumerated = 0; // next words whose LM probabilities were looked up one by one (sampling)
+	size_t lmLookups = 0; // unigram and bigram probability lookups, including precomputed sums over next words
+	double expansionTime = 0.0; // seconds spent creating and adding child beams, including LM scoring
+	double selectionTime = 0.0; // seconds spent selecting the best beams
+	double lmTime = 0.0; // seconds spent scoring beam texts by the LM
+
+	// true if compiled with WBS_STATS
+	static bool isEnabled()
+	{
+#ifdef WBS_STATS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	// add values of other object, e.g. to sum up over batch elements
+	void add(const DecodeStats& other)
+	{
+		timeSteps += other.timeSteps;
+		blankFrames += other.blankFrames;
+		beamsExpanded += other.beamsExpanded;
+		candidates += other.candidates;
+		merges += other.merges;
+		trieWalks += other.trieWalks;
+		nextWordsCalls += other.nextWordsCalls;
+		nextWordsEnumerated += other.nextWordsEnumerated;
+		lmLookups += other.lmLookups;
+		expansionTime += other.expansionTime;
+		selectionTime += other.selectionTime;
+		lmTime += other.lmTime;
+	}
+
+	// object which collects the statistics of the calling thread, nullptr if none
+	static DecodeStats*& current()
+	{
+		static thread_local DecodeStats* stats = nullptr;
+		return stats;
+	}
+
+	// statistics of the calling thread are added to the given object (nullptr to collect nothing) while this object exists
+	class Collect
+	{
+	public:
+		explicit Collect(DecodeStats* stats) :m_prev(current()) { current() = stats; }
+		~Collect() { current() = m_prev; }
+		Collect(const Collect&) = delete;
+		Collect& operator=(const Collect&) = delete;
+
+	private:
+		DecodeStats* m_prev;
+	};
+
+	// adds the time from construction until stop() or destruction to a timer of the collecting object
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(double DecodeStats::*timer) :m_timer(timer), m_startTime(std::chrono::steady_clock::now()) {}
+		~ScopedTimer() { stop(); }
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+		void stop()
+		{
+			DecodeStats* stats = current();
+			if (m_timer && stats)
+			{
+				stats->*m_timer += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+			}
+			m_timer = nullptr;
+		}
+
+	private:
+		double DecodeStats::*m_timer;
+		std::chrono::steady_clock::time_point m_startTime;
+	};
+};
+
+
+#ifdef WBS_STATS
+#define WBS_STATS_ADD(counter, n) do { if (DecodeStats* wbsStats = DecodeStats::current()) { wbsStats->counter += (n); } } while (false)
+#define WBS_STATS_TIMER(name, timer) DecodeStats::ScopedTimer name(&DecodeStats::timer)
+#define WBS_STATS_STOP(name) name.stop()
+#else
+#define WBS_STATS_ADD(counter, n) do {} while (false)
+#define WBS_STATS_TIMER(name, timer) do {} while (false)
+#define WBS_STATS_STOP(name) do {} while (false)
+#endif
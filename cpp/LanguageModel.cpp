@@ -6,6 +6,11 @@
 #include <cassert>
 
 
+const uint64_t LanguageModel::fileMagic;
+const uint32_t LanguageModel::fileVersion;
+const uint32_t LanguageModel::fileByteOrderMark;
+
+
 LanguageModel::LanguageModel(const std::string& corpus, const std::string& chars, const std::string& wordChars, LanguageModelType lmType, double addK)
 :m_addK(addK)
 {
@@ -35,62 +40,198 @@ LanguageModel::LanguageModel(const std::string& corpus, const std::string& chars
 	}
 
 
-	// calc unigram, add words to tree
-	const double wordWeight = 1.0 / wordList.size();
+	// add words to tree, all words are added, reorganize tree for faster access
+	m_tree.addWords(wordList);
+	m_tree.allWordsAdded();
+
+	// map words to their ids, the tokenized corpus is not needed anymore
+	std::vector<uint32_t> wordIds;
+	wordIds.reserve(wordList.size());
 	for (const auto& w : wordList)
 	{
-		// not yet in list: add to list and add to tree
-		if (m_unigrams.find(w) == m_unigrams.end())
-		{
-			// add to prefix tree
-			m_tree.addWord(w);
-
-			// assign unique id
-			m_unigrams[w] = Unigram();
-		}
-
-		Unigram& unigram = m_unigrams[w];
-		unigram.prob += wordWeight;
-		unigram.count++;
+		wordIds.push_back(getWordId(w));
 	}
+	wordList = std::vector<std::vector<uint32_t>>();
 
-	// all words are added, reorganize tree for faster access
-	m_tree.allWordsAdded();
+	// calc unigrams
+	const size_t numWords = getNumWords();
+	std::vector<uint32_t> unigramCounts(numWords, 0);
+	for (const auto w : wordIds)
+	{
+		unigramCounts[w]++;
+	}
+	m_numTokens = wordIds.size();
+	m_unigramCounts = DataArray<uint32_t>(std::move(unigramCounts));
 
-	// leave CTOR if no NGrams are needed
-	if (lmType == LanguageModelType::Words)
+	// prefix sums of unigram probabilities in the order of the word ids
+	std::vector<double> unigramProbSums(1, 0.0);
+	for (uint32_t w = 0; w < numWords; ++w)
 	{
-		return;
+		unigramProbSums.push_back(unigramProbSums.back() + getUnigramProb(w));
+	}
+	m_unigramProbSums = DataArray<double>(std::move(unigramProbSums));
+
+	// calc bigrams if NGrams are needed: sort all word pairs, then count equal pairs
+	m_hasBigrams = lmType != LanguageModelType::Words;
+	std::vector<uint32_t> bigramOffsets(numWords + 1, 0);
+	std::vector<uint32_t> bigramSuccessors;
+	std::vector<uint32_t> bigramCounts;
+	if (m_hasBigrams)
+	{
+		std::vector<std::pair<uint32_t, uint32_t>> wordPairs;
+		for (size_t i = 0; !wordIds.empty() && i < wordIds.size() - 1; ++i)
+		{
+			wordPairs.push_back(std::make_pair(wordIds[i], wordIds[i + 1]));
+		}
+		std::sort(wordPairs.begin(), wordPairs.end());
+		for (size_t i = 0; i < wordPairs.size(); ++i)
+		{
+			if (i == 0 || wordPairs[i] != wordPairs[i - 1])
+			{
+				bigramOffsets[wordPairs[i].first + 1]++;
+				bigramSuccessors.push_back(wordPairs[i].second);
+				bigramCounts.push_back(0);
+			}
+			bigramCounts.back()++;
+		}
 	}
 
-	// calc bigrams
-	for (size_t i=0; !wordList.empty() && i<wordList.size()-1; ++i)
+	// number of successors per word -> offsets of successors
+	for (size_t w = 0; w < numWords; ++w)
 	{
-		const std::vector<uint32_t>& w1 = wordList[i];
-		const std::vector<uint32_t>& w2 = wordList[i+1];
+		bigramOffsets[w + 1] += bigramOffsets[w];
+	}
+	m_bigramOffsets = DataArray<uint32_t>(std::move(bigramOffsets));
+	m_bigramSuccessors = DataArray<uint32_t>(std::move(bigramSuccessors));
+	m_bigramCounts = DataArray<uint32_t>(std::move(bigramCounts));
 
-		// insert new bigram if needed
-		assert(m_unigrams.find(w1) != m_unigrams.end());
-		if (m_unigrams[w1].bigrams.find(w2) == m_unigrams[w1].bigrams.end())
+	// prefix sums of bigram probabilities in the order of the successors, restarted for each word so that the sums stay small and precise
+	std::vector<double> bigramProbSums;
+	for (uint32_t w = 0; w < numWords; ++w)
+	{
+		double sum = 0.0;
+		for (size_t i = m_bigramOffsets[w]; i < m_bigramOffsets[w + 1]; ++i)
 		{
-			m_unigrams[w1].bigrams[w2] = Bigram();
+			sum += getStoredBigramProb(w, i);
+			bigramProbSums.push_back(sum);
 		}
+	}
+	m_bigramProbSums = DataArray<double>(std::move(bigramProbSums));
+}
 
-		// add 1 to bigram count
-		Bigram& bigram = m_unigrams[w1].bigrams[w2];
-		bigram.count++;
+
+void LanguageModel::save(const std::string& path) const
+{
+	BinaryWriter writer(path);
+
+	// header
+	writer.writeValue(fileMagic);
+	writer.writeValue(fileVersion);
+	writer.writeValue(fileByteOrderMark);
+
+	// settings and chars
+	writer.writeValue(m_addK);
+	writer.writeValue(uint64_t(m_numTokens));
+	writer.writeValue(uint32_t(m_hasBigrams));
+	writer.writeArray(m_labelToCodepoint);
+	writer.writeArray(std::vector<uint32_t>(m_wordLabels.begin(), m_wordLabels.end()));
+
+	// prefix tree, unigrams and bigrams
+	m_tree.write(writer);
+	writer.writeArray(m_unigramCounts);
+	writer.writeArray(m_unigramProbSums);
+	writer.writeArray(m_bigramOffsets);
+	writer.writeArray(m_bigramSuccessors);
+	writer.writeArray(m_bigramCounts);
+	writer.writeArray(m_bigramProbSums);
+	writer.close();
+}
+
+
+std::shared_ptr<LanguageModel> LanguageModel::load(const std::string& path)
+{
+	std::shared_ptr<LanguageModel> lm(new LanguageModel());
+	lm->m_file = std::make_shared<MappedFile>(path);
+	BinaryReader reader(*lm->m_file);
+
+	// header
+	if (reader.readValue<uint64_t>() != fileMagic)
+	{
+		throw std::runtime_error("not a language model file: " + path);
+	}
+	if (reader.readValue<uint32_t>() != fileVersion)
+	{
+		throw std::runtime_error("unsupported version of language model file: " + path);
+	}
+	if (reader.readValue<uint32_t>() != fileByteOrderMark)
+	{
+		throw std::runtime_error("language model file was written on a machine with different byte order: " + path);
 	}
 
-	// normalize bigrams
-	for (auto& kv1 : m_unigrams)
+	// settings and chars, the small lookup tables for chars are created in memory
+	lm->m_addK = reader.readValue<double>();
+	lm->m_numTokens = static_cast<size_t>(reader.readValue<uint64_t>());
+	lm->m_hasBigrams = reader.readValue<uint32_t>() != 0;
+	const auto labelToCodepoint = reader.readArray<uint32_t>();
+	const auto wordLabels = reader.readArray<uint32_t>();
+	lm->m_labelToCodepoint.assign(labelToCodepoint.begin(), labelToCodepoint.end());
+	lm->m_codepointToLabel = lm->codepointToLabelMapping(lm->m_labelToCodepoint);
+	std::vector<uint32_t> wordCodepoints;
+	for (const auto label : wordLabels)
+	{
+		if (label >= labelToCodepoint.size())
+		{
+			throw std::runtime_error("binary file is corrupt: unknown word char");
+		}
+		wordCodepoints.push_back(labelToCodepoint[label]);
+	}
+	lm->initLabelSets(lm->m_codepointToLabel, wordCodepoints);
+
+	// prefix tree, unigrams and bigrams refer to the mapped file
+	lm->m_tree.read(reader, labelToCodepoint.size());
+	lm->m_unigramCounts = reader.readArray<uint32_t>();
+	lm->m_unigramProbSums = reader.readArray<double>();
+	lm->m_bigramOffsets = reader.readArray<uint32_t>();
+	lm->m_bigramSuccessors = reader.readArray<uint32_t>();
+	lm->m_bigramCounts = reader.readArray<uint32_t>();
+	lm->m_bigramProbSums = reader.readArray<double>();
+
+	// check sizes, so that the queries stay inside of the arrays
+	const size_t numWords = lm->getNumWords();
+	if (lm->m_unigramCounts.size() != numWords
+		|| lm->m_unigramProbSums.size() != numWords + 1
+		|| lm->m_bigramOffsets.size() != numWords + 1
+		|| lm->m_bigramOffsets[0] != 0
+		|| lm->m_bigramOffsets[numWords] != lm->m_bigramSuccessors.size()
+		|| lm->m_bigramCounts.size() != lm->m_bigramSuccessors.size()
+		|| lm->m_bigramProbSums.size() != lm->m_bigramSuccessors.size())
 	{
-		Unigram& unigram = kv1.second;
-		for (auto& kv2 : unigram.bigrams)
+		throw std::runtime_error("binary file is corrupt: inconsistent unigram or bigram tables");
+	}
+	for (size_t w = 0; w < numWords; ++w)
+	{
+		if (lm->m_bigramOffsets[w] > lm->m_bigramOffsets[w + 1])
 		{
-			Bigram& bigram = kv2.second;
-			bigram.prob = (bigram.count + m_addK) / (unigram.count + m_addK*m_unigrams.size());
+			throw std::runtime_error("binary file is corrupt: bigram offsets are not sorted");
+		}
+
+		// successors of a word must be valid word ids sorted in ascending order
+		for (size_t i = lm->m_bigramOffsets[w]; i < lm->m_bigramOffsets[w + 1]; ++i)
+		{
+			if (lm->m_bigramSuccessors[i] >= numWords || (i > lm->m_bigramOffsets[w] && lm->m_bigramSuccessors[i] <= lm->m_bigramSuccessors[i - 1]))
+			{
+				throw std::runtime_error("binary file is corrupt: invalid bigram successor");
+			}
 		}
 	}
+
+	return lm;
+}
+
+
+bool LanguageModel::hasBigrams() const
+{
+	return m_hasBigrams;
 }
 
 
@@ -148,39 +289,111 @@ std::string LanguageModel::labelToUtf8(const std::vector<uint32_t>& labelStr)
 }
 
 
-double LanguageModel::getUnigramProb(const std::vector<uint32_t>& w) const
+uint32_t LanguageModel::getWordId(const std::vector<uint32_t>& text) const
 {
-	// get entry for w
-	const auto iter = m_unigrams.find(w);
-	if (iter == m_unigrams.end())
+	return m_tree.getWordId(m_tree.getNode(text));
+}
+
+
+uint32_t LanguageModel::getWordId(PrefixTree::NodeId node) const
+{
+	return m_tree.getWordId(node);
+}
+
+
+size_t LanguageModel::getNumWords() const
+{
+	return m_tree.getNumWords();
+}
+
+
+double LanguageModel::getUnigramProb(uint32_t w) const
+{
+	if (w == PrefixTree::invalidId)
 	{
 		return 0.0;
 	}
 
-	// return unigram prob
-	return iter->second.prob;
+	return double(m_unigramCounts[w]) / m_numTokens;
 }
 
 
-double LanguageModel::getBigramProb(const std::vector<uint32_t>& w1, const std::vector<uint32_t>& w2) const
+double LanguageModel::getBigramProb(uint32_t w1, uint32_t w2) const
 {
-	// get entry for w1
-	const auto iter1 = m_unigrams.find(w1);
-	if (iter1 == m_unigrams.end())
+	if (w1 == PrefixTree::invalidId)
 	{
 		return 0.0;
 	}
 
-	// get entry for w2
-	const Unigram& unigram = iter1->second;
-	const auto iter2 = unigram.bigrams.find(w2);
-	if (iter2 == unigram.bigrams.end())
+	// search w2 in successors of w1 (binary search)
+	const auto begin = m_bigramSuccessors.begin() + m_bigramOffsets[w1];
+	const auto end = m_bigramSuccessors.begin() + m_bigramOffsets[w1 + 1];
+	const auto iter = std::lower_bound(begin, end, w2);
+	if (iter == end || *iter != w2)
 	{
-		return m_addK / (unigram.count + m_addK*m_unigrams.size());
+		return getUnseenBigramProb(w1);
 	}
 
 	// return bigram prob
-	return iter2->second.prob;
+	return getStoredBigramProb(w1, iter - m_bigramSuccessors.begin());
+}
+
+
+double LanguageModel::getUnigramProb(const std::vector<uint32_t>& w) const
+{
+	return getUnigramProb(getWordId(w));
+}
+
+
+double LanguageModel::getBigramProb(const std::vector<uint32_t>& w1, const std::vector<uint32_t>& w2) const
+{
+	return getBigramProb(getWordId(w1), getWordId(w2));
+}
+
+
+double LanguageModel::getStoredBigramProb(uint32_t w1, size_t successorIdx) const
+{
+	return (m_bigramCounts[successorIdx] + m_addK) / (m_unigramCounts[w1] + m_addK*getNumWords());
+}
+
+
+double LanguageModel::getUnseenBigramProb(uint32_t w1) const
+{
+	return m_addK / (m_unigramCounts[w1] + m_addK*getNumWords());
+}
+
+
+double LanguageModel::getBigramProbSum(uint32_t w1, size_t successorIdx) const
+{
+	return successorIdx == m_bigramOffsets[w1] ? 0.0 : m_bigramProbSums[successorIdx - 1];
+}
+
+
+double LanguageModel::getNextWordsUnigramProb(PrefixTree::NodeId node) const
+{
+	// the next words of a node have contiguous ids, so their probability mass is the difference of two prefix sums
+	const auto wordIds = m_tree.getNextWordIds(node);
+	return m_unigramProbSums[wordIds.second] - m_unigramProbSums[wordIds.first];
+}
+
+
+double LanguageModel::getNextWordsBigramProb(uint32_t w1, PrefixTree::NodeId node) const
+{
+	if (w1 == PrefixTree::invalidId)
+	{
+		return 0.0;
+	}
+
+	// successors of w1 inside the id range of the next words
+	const auto wordIds = m_tree.getNextWordIds(node);
+	const auto begin = m_bigramSuccessors.begin() + m_bigramOffsets[w1];
+	const auto end = m_bigramSuccessors.begin() + m_bigramOffsets[w1 + 1];
+	const size_t first = std::lower_bound(begin, end, wordIds.first) - m_bigramSuccessors.begin();
+	const size_t last = std::lower_bound(begin, end, wordIds.second) - m_bigramSuccessors.begin();
+
+	// seen bigrams, all other next words get the add-k smoothing probability
+	const size_t numUnseen = (wordIds.second - wordIds.first) - (last - first);
+	return getBigramProbSum(w1, last) - getBigramProbSum(w1, first) + numUnseen * getUnseenBigramProb(w1);
 }
 
 
@@ -197,17 +410,65 @@ std::vector<std::vector<uint32_t>> LanguageModel::getNextWords(const std::vector
 
 
 std::vector<uint32_t> LanguageModel::getNextChars(const std::vector<uint32_t>& text) const
+{
+	std::vector<uint32_t> res;
+	getNextChars(text, res);
+	return res;
+}
+
+
+void LanguageModel::getNextChars(const std::vector<uint32_t>& text, std::vector<uint32_t>& res) const
+{
+	getNextChars(m_tree.getNode(text), res);
+}
+
+
+PrefixTree::NodeId LanguageModel::getRootNode() const
+{
+	return m_tree.getRoot();
+}
+
+
+PrefixTree::NodeId LanguageModel::getChildNode(PrefixTree::NodeId node, uint32_t c) const
+{
+	return m_tree.getChild(node, c);
+}
+
+
+bool LanguageModel::isWord(PrefixTree::NodeId node) const
+{
+	return m_tree.isWord(node);
+}
+
+
+std::vector<std::vector<uint32_t>> LanguageModel::getNextWords(PrefixTree::NodeId node) const
+{
+	return m_tree.getNextWords(node);
+}
+
+
+std::pair<uint32_t, uint32_t> LanguageModel::getNextWordIds(PrefixTree::NodeId node) const
+{
+	return m_tree.getNextWordIds(node);
+}
+
+
+std::pair<const uint32_t*, const uint32_t*> LanguageModel::getWordLabels(uint32_t wordId) const
+{
+	return m_tree.getWordLabels(wordId);
+}
+
+
+void LanguageModel::getNextChars(PrefixTree::NodeId node, std::vector<uint32_t>& res) const
 {
 	// query tree
-	std::vector<uint32_t> res(m_tree.getNextChars(text));
+	m_tree.getNextChars(node, res);
 	
 	// if between words or if word is complete, then add non word chars
-	if (text.empty() || isWord(text))
+	if (node == m_tree.getRoot() || m_tree.isWord(node))
 	{
-		res.insert(res.end(), m_nonWordLabels.begin(), m_nonWordLabels.end());
+		res.insert(res.end(), m_nonWordLabelList.begin(), m_nonWordLabelList.end());
 	}
-
-	return res;
 }
 
 
@@ -231,6 +492,20 @@ void LanguageModel::initLabelSets(const std::unordered_map<uint32_t, uint32_t>&
 
 		m_allLabels.insert(label);
 	}
+
+	// fast lookup for the decoder
+	m_nonWordLabelList.assign(m_nonWordLabels.begin(), m_nonWordLabels.end());
+	m_isWordLabel.assign(m_allLabels.empty() ? 0 : *m_allLabels.rbegin() + 1, false);
+	for (const auto label : m_wordLabels)
+	{
+		m_isWordLabel[label] = true;
+	}
+}
+
+
+bool LanguageModel::isWordChar(uint32_t label) const
+{
+	return label < m_isWordLabel.size() && m_isWordLabel[label];
 }
 
 
@@ -1,8 +1,10 @@
 #pragma once
-#include "HashFunction.hpp"
 #include "PrefixTree.hpp"
+#include "DataArray.hpp"
+#include "BinaryFile.hpp"
 #include <string>
 #include <vector>
+#include <memory>
 #include <map>
 #include <set>
 #include <unordered_map>
@@ -15,7 +17,7 @@ enum class LanguageModelType
 {
 	Words // use no N-grams, but restrict output to words from corpus (very fast)
 	, NGrams // consider N-grams each time when beam text finishes a new word (fast)
-	, NGramsForecast // consider N-grams for possible following words each time a characters is added to beam text (very slow)
+	, NGramsForecast // consider N-grams for possible following words each time a characters is added to beam text (fast, probability mass of following words is precomputed)
 	, NGramsForecastAndSample // consider N-grams for subset of possible following words each time a characters is added to beam text (slow)
 };
 
@@ -27,42 +29,79 @@ public:
 	// CTOR
 	LanguageModel(const std::string& corpus, const std::string& chars, const std::string& wordChars, LanguageModelType lmType, double addK = 0.0);
 
+	// write LM to a binary file, load LM from such a file (throws std::runtime_error on failure).
+	// The loaded LM maps the file read-only and uses its tables without copying them.
+	// Saving writes path + ".tmp" and renames it to path, so processes which have loaded the old file keep using it
+	void save(const std::string& path) const;
+	static std::shared_ptr<LanguageModel> load(const std::string& path);
+	bool hasBigrams() const; // false if LM was created for LanguageModelType::Words
+
+	// words are identified by their ids in the prefix tree, PrefixTree::invalidId if the text is not a word
+	uint32_t getWordId(const std::vector<uint32_t>& text) const;
+	uint32_t getWordId(PrefixTree::NodeId node) const;
+	size_t getNumWords() const;
+
 	// unigram and bigram probability
+	double getUnigramProb(uint32_t w) const;
+	double getBigramProb(uint32_t w1, uint32_t w2) const;
 	double getUnigramProb(const std::vector<uint32_t>& w) const;
 	double getBigramProb(const std::vector<uint32_t>& w1, const std::vector<uint32_t>& w2) const;
+	double getNextWordsUnigramProb(PrefixTree::NodeId node) const; // sum of unigram probabilities of all words starting with the text of the node, O(1)
+	double getNextWordsBigramProb(uint32_t w1, PrefixTree::NodeId node) const; // same for bigram probabilities given w1, O(log(#successors of w1))
 
 	// given some text, check if it is a word, give next possible words, give next possible characters
 	bool isWord(const std::vector<uint32_t>& text) const;
 	std::vector<std::vector<uint32_t>> getNextWords(const std::vector<uint32_t>& text) const;
 	std::vector<uint32_t> getNextChars(const std::vector<uint32_t>& text) const;
+	void getNextChars(const std::vector<uint32_t>& text, std::vector<uint32_t>& res) const; // result written to res, reuses its memory
+
+	// same queries for the text represented by a node of the prefix tree, which can be advanced char by char
+	PrefixTree::NodeId getRootNode() const;
+	PrefixTree::NodeId getChildNode(PrefixTree::NodeId node, uint32_t c) const;
+	bool isWord(PrefixTree::NodeId node) const;
+	std::vector<std::vector<uint32_t>> getNextWords(PrefixTree::NodeId node) const;
+	void getNextChars(PrefixTree::NodeId node, std::vector<uint32_t>& res) const;
+
+	// words are numbered in depth-first order of the prefix tree: the next words of a node are an id range [first, end)
+	std::pair<uint32_t, uint32_t> getNextWordIds(PrefixTree::NodeId node) const;
+	std::pair<const uint32_t*, const uint32_t*> getWordLabels(uint32_t wordId) const;
 
 	// char sets
 	const std::set<uint32_t>& getAllChars() const; 
 	const std::set<uint32_t>& getWordChars() const; 
 	const std::set<uint32_t>& getNonWordChars() const;
+	bool isWordChar(uint32_t label) const;
 
 	// utf8 -> label ->utf8
 	std::vector<uint32_t> utf8ToLabel(const std::string& utf8Str); 
 	std::string labelToUtf8(const std::vector<uint32_t>& labelStr); 
 
 private:
-	// words, unigrams and bigrams
-	struct Bigram
-	{
-		size_t count = 0;
-		double prob = 0.0;
-	};
-
-	struct Unigram
-	{
-		size_t count = 0;
-		double prob = 0.0;
-		std::unordered_map<std::vector<uint32_t>, Bigram, HashFunction> bigrams;
-	};
-
-	std::unordered_map<std::vector<uint32_t>, Unigram, HashFunction> m_unigrams;
+	// CTOR for loading LM from file
+	LanguageModel() = default;
+
+	// file format: magic "WBSLM\0\0\0", version and byte order mark, followed by values and arrays written by BinaryWriter
+	static const uint64_t fileMagic = 0x4d4c534257ull;
+	static const uint32_t fileVersion = 2;
+	static const uint32_t fileByteOrderMark = 0x01020304;
+	std::shared_ptr<MappedFile> m_file; // file the tables refer to if the LM is loaded, nullptr otherwise
+
+	// unigrams and bigrams, indexed by word id
+	size_t m_numTokens = 0; // number of words in the corpus
+	DataArray<uint32_t> m_unigramCounts;
+	DataArray<double> m_unigramProbSums; // prefix sums of unigram probabilities, ordered by word id: entry i holds the sum for words [0, i)
+
+	// successors of word i are m_bigramSuccessors[m_bigramOffsets[i]...m_bigramOffsets[i+1]], sorted by id
+	bool m_hasBigrams = false;
+	DataArray<uint32_t> m_bigramOffsets;
+	DataArray<uint32_t> m_bigramSuccessors;
+	DataArray<uint32_t> m_bigramCounts;
+	DataArray<double> m_bigramProbSums; // prefix sums of bigram probabilities per word in the order of m_bigramSuccessors: entry i holds the sum for the successors of the word up to and including i
 
 	double m_addK = 0.0; // add-k smoothing
+	double getStoredBigramProb(uint32_t w1, size_t successorIdx) const; // probability of the bigram stored at given index of m_bigramSuccessors
+	double getUnseenBigramProb(uint32_t w1) const; // probability of a word pair not contained in the corpus
+	double getBigramProbSum(uint32_t w1, size_t successorIdx) const; // sum of the probabilities of the successors of w1 stored before given index
 
 	// prefix tree
 	PrefixTree m_tree;
@@ -76,6 +115,8 @@ private:
 	std::set<uint32_t> m_allLabels;
 	std::set<uint32_t> m_wordLabels;
 	std::set<uint32_t> m_nonWordLabels;
+	std::vector<uint32_t> m_nonWordLabelList;
+	std::vector<bool> m_isWordLabel;
 
 	// map between utf8, codepoints and labels
 	std::vector<uint32_t> utf8ToCodepoint(const std::string& s);
@@ -6,6 +6,7 @@ MatrixCSV::MatrixCSV(const std::string& filename)
 {
 	std::ifstream f(filename);
 	std::string line;
+	m_cols = 0;
 	
 	while (std::getline(f, line))
 	{
@@ -27,24 +28,30 @@ MatrixCSV::MatrixCSV(const std::string& filename)
 
 		if (!row.empty())
 		{
-			m_data.push_back(row);
+			m_cols = row.size();
+			m_data.insert(m_data.end(), row.begin(), row.end());
 		}
 	}
 
-	m_rows = m_data.size();
-	m_cols = m_data.front().size();
+	m_rows = m_cols ? m_data.size() / m_cols : 0;
 }
 
 
 double MatrixCSV::getAt(size_t row, size_t col) const
 {
-	return m_data[row][col];
+	return m_data[row * m_cols + col];
 }
 
 
 void MatrixCSV::setAt(size_t row, size_t col, double val)
 {
-	m_data[row][col] = val;
+	m_data[row * m_cols + col] = val;
+}
+
+
+MatrixView<double> MatrixCSV::getView() const
+{
+	return MatrixView<double>(m_data.data(), m_rows, m_cols, static_cast<ptrdiff_t>(m_cols));
 }
 
 
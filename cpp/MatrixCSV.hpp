@@ -1,5 +1,6 @@
 #pragma once
 #include "IMatrix.hpp"
+#include "MatrixView.hpp"
 #include <string>
 #include <vector>
 
@@ -14,8 +15,9 @@ public:
 	virtual void setAt(size_t row, size_t col, double val);
 	size_t rows() const { return m_rows; }
 	size_t cols() const { return m_cols; }
+	MatrixView<double> getView() const; // view for decoding, valid as long as the matrix lives
 
 private:
-	std::vector<std::vector<double>> m_data;
+	std::vector<double> m_data; // row-major
 };
 
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+
+
+// non-owning view of a matrix stored in memory, e.g. one batch element of a TxBxC tensor.
+// Element (row, col) is data[row*rowStride + col*colStride], access is inline and needs no virtual call
+template<class T>
+class MatrixView
+{
+public:
+	// CTOR
+	MatrixView(const T* data, size_t rows, size_t cols, ptrdiff_t rowStride, ptrdiff_t colStride = 1)
+	:m_data(data)
+	,m_rows(rows)
+	,m_cols(cols)
+	,m_rowStride(rowStride)
+	,m_colStride(colStride)
+	{
+	}
+
+	// batch element b of a C-contiguous TxBxC tensor, only the first numT time-steps are used
+	static MatrixView fromBatch(const T* data, size_t b, size_t numT, size_t maxB, size_t maxC)
+	{
+		return MatrixView(data + b * maxC, numT, maxC, static_cast<ptrdiff_t>(maxB * maxC));
+	}
+
+	// batch element b of a TxBxC tensor with arbitrary strides (given in elements, not bytes), e.g. a transposed BxTxC array
+	static MatrixView fromBatch(const T* data, size_t b, size_t numT, size_t maxC, ptrdiff_t strideT, ptrdiff_t strideB, ptrdiff_t strideC)
+	{
+		return MatrixView(data + static_cast<ptrdiff_t>(b) * strideB, numT, maxC, strideT, strideC);
+	}
+
+	size_t rows() const { return m_rows; }
+	size_t cols() const { return m_cols; }
+	const T* row(size_t r) const { return m_data + static_cast<ptrdiff_t>(r) * m_rowStride; } // element c of row r is row(r)[c*colStride()]
+	ptrdiff_t colStride() const { return m_colStride; }
+	T getAt(size_t r, size_t c) const { return row(r)[static_cast<ptrdiff_t>(c) * m_colStride]; }
+
+private:
+	const T* m_data;
+	size_t m_rows;
+	size_t m_cols;
+	ptrdiff_t m_rowStride;
+	ptrdiff_t m_colStride;
+};
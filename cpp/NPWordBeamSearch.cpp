@@ -2,19 +2,147 @@
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
 #include <string>
+#include <algorithm>
 #include <cctype>
 #include <memory>
+#include <mutex>
+#include <tuple>
 #include <exception>
 #include <cstddef>
 #include <stdint.h>
-#include "MatrixArray.hpp"
+#include "MatrixView.hpp"
 #include "WordBeamSearch.hpp"
 #include "LanguageModel.hpp"
+#include "ThreadPool.hpp"
+#include "DecodeStats.hpp"
+#include "StreamDecoder.hpp"
 
 
 namespace py = pybind11;
 
 
+namespace
+{
+	// arrays are passed through, other objects (e.g. nested lists) are converted to an array.
+	// Throws py::type_error naming the argument if the conversion fails
+	py::array toArray(const py::object& obj, const std::string& name)
+	{
+		auto array = py::array::ensure(obj);
+		if (!array)
+		{
+			throw py::type_error(name + " must be convertible to an array");
+		}
+		return array;
+	}
+
+
+	// check if array holds elements of type T (in native byte order) whose strides are multiples of the element size
+	template<class T>
+	bool isReadableAs(const py::array& array)
+	{
+		if (!py::isinstance<py::array_t<T>>(array))
+		{
+			return false;
+		}
+		for (py::ssize_t i = 0; i < array.ndim(); ++i)
+		{
+			if (array.strides(i) % py::ssize_t(sizeof(T)) != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+
+// pybind11 interface of the stream decoder, which decodes an input given in chunks of time-steps
+class NPStreamDecoder
+{
+public:
+	// CTOR: created by NPWordBeamSearch::createStream with its LM and settings
+	NPStreamDecoder(const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, size_t beamWidth, bool logDomain, const CharPruning& pruning, size_t numChars)
+	:m_decoder(lm, lmType, beamWidth, logDomain, pruning)
+	,m_numChars(numChars)
+	{
+	}
+
+
+	// decode the next time-steps given as NumPy array (TxC), float32 and float64 arrays are read in place
+	void push(const py::object& frames)
+	{
+		const py::array array = toArray(frames, "frames");
+		if (array.ndim() != 2 || size_t(array.shape(1)) != m_numChars + 1)
+		{
+			throw std::invalid_argument("frames must have 2 dimensions (TxC) and the number of characters (chars) plus 1 must equal dimension 1");
+		}
+
+		if (isReadableAs<float>(array))
+		{
+			pushArray<float>(array);
+		}
+		else if (isReadableAs<double>(array))
+		{
+			pushArray<double>(array);
+		}
+		else
+		{
+			// ensure clears the Python error if the conversion fails
+			const auto converted = py::array_t<double, py::array::c_style | py::array::forcecast>::ensure(array);
+			if (!converted)
+			{
+				throw py::type_error("frames must be convertible to a float64 array");
+			}
+			pushArray<double>(converted);
+		}
+	}
+
+
+	// best label-string of the time-steps decoded so far
+	std::vector<uint32_t> partial()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_decoder.partial();
+	}
+
+
+	// final label-string, the decoder is reset afterwards
+	std::vector<uint32_t> finalize()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_decoder.finalize();
+	}
+
+
+	void reset()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_decoder.reset();
+	}
+
+
+	size_t getNumFrames()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_decoder.getNumFrames();
+	}
+
+private:
+	StreamDecoder m_decoder;
+	size_t m_numChars = 0;
+	std::mutex m_mutex; // the GIL is released while decoding, so calls from different Python threads must be serialized
+
+	template<class T>
+	void pushArray(const py::array& array)
+	{
+		const MatrixView<T> frames(static_cast<const T*>(array.data()), array.shape(0), array.shape(1), array.strides(0) / py::ssize_t(sizeof(T)), array.strides(1) / py::ssize_t(sizeof(T)));
+		py::gil_scoped_release release;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_decoder.push(frames);
+	}
+};
+
+
 // pybind11 NumPy interface
 class NPWordBeamSearch
 {
@@ -23,14 +151,13 @@ private:
 	size_t m_beamWidth = 0;
 	size_t m_numChars = 0;
 	LanguageModelType m_lmType = LanguageModelType::Words;
+	bool m_logDomain = false;
+	CharPruning m_pruning;
+	std::shared_ptr<ThreadPool> m_threadPool; // decodes the batch elements in parallel
 
-public:
-	// CTOR
-	NPWordBeamSearch(size_t beamWidth, std::string lmType, float lmSmoothing, const std::string& corpus, const std::string& chars, const std::string& wordChars)
+	// map string to enum
+	void setLmType(std::string lmType)
 	{
-		m_beamWidth = beamWidth;
-
-		// map string to enum
 		std::transform(lmType.begin(), lmType.end(), lmType.begin(), tolower);
 		if (lmType == "words")
 		{
@@ -52,30 +179,197 @@ public:
 		{
 			throw std::invalid_argument("unknown LM type (lmType)");
 		}
+	}
 
-		// create language model
-		m_lm = std::make_shared<LanguageModel>(corpus, chars, wordChars, m_lmType, lmSmoothing);
 
+	// check string sizes now and the mat size later in the compute method
+	void checkChars()
+	{
 		// query number of chars (may be different to chars.size()) to check tensor shape
 		m_numChars = m_lm->getAllChars().size();
 
-		// check string sizes now and the mat size later in the compute method
 		const size_t numWordChars = m_lm->getWordChars().size();
 		if (!(numWordChars > 0 && numWordChars <= m_numChars))
 		{
 			throw std::invalid_argument("check length of chars and wordChars: 0<len(wordChars)<=len(chars)");
 		}
+	}
 
+public:
+	// CTOR: create LM from text
+	NPWordBeamSearch(size_t beamWidth, std::string lmType, float lmSmoothing, const std::string& corpus, const std::string& chars, const std::string& wordChars, bool logDomain, size_t numThreads, double pruneMinProb, size_t pruneTopN, double blankThreshold)
+	{
+		m_beamWidth = beamWidth;
+		m_logDomain = logDomain;
+		m_pruning = CharPruning(pruneMinProb, pruneTopN, blankThreshold);
+		m_threadPool = std::make_shared<ThreadPool>(numThreads);
+		setLmType(lmType);
+
+		// create language model
+		m_lm = std::make_shared<LanguageModel>(corpus, chars, wordChars, m_lmType, lmSmoothing);
+		checkChars();
 	}
 
 
-	// method which gets a NumPy array (TxBxC) as input and returns a list of B lists (label-strings)
-	std::vector<std::vector<uint32_t>> compute(const py::array_t<double, py::array::c_style | py::array::forcecast>& array) const
+	// CTOR: load LM from binary file written by saveLm
+	NPWordBeamSearch(size_t beamWidth, std::string lmType, const std::string& lmFile, bool logDomain, size_t numThreads, double pruneMinProb, size_t pruneTopN, double blankThreshold)
 	{
-		py::buffer_info buf = array.request();
-		const size_t maxT = buf.shape[0];
-		const size_t maxB = buf.shape[1];
-		const size_t maxC = buf.shape[2];
+		m_beamWidth = beamWidth;
+		m_logDomain = logDomain;
+		m_pruning = CharPruning(pruneMinProb, pruneTopN, blankThreshold);
+		m_threadPool = std::make_shared<ThreadPool>(numThreads);
+		setLmType(lmType);
+
+		// load language model
+		m_lm = LanguageModel::load(lmFile);
+		if (m_lmType != LanguageModelType::Words && !m_lm->hasBigrams())
+		{
+			throw std::invalid_argument("LM file (lmFile) was created for LM type Words and can not be used for N-grams");
+		}
+		checkChars();
+	}
+
+
+	// write LM to binary file
+	void saveLm(const std::string& lmFile) const
+	{
+		m_lm->save(lmFile);
+	}
+
+
+	// method which gets a NumPy array (TxBxC) as input and returns a list of B lists (label-strings).
+	// Optionally, the number of time-steps of each batch element is given (B values), the remaining time-steps are not decoded.
+	// float32 and float64 arrays are read in place, also if they are not contiguous (e.g. a transposed BxTxC array)
+	std::vector<std::vector<uint32_t>> compute(const py::object& mat, const std::vector<int64_t>& seqLengths) const
+	{
+		return getBestTexts(decode(toArray(mat, "mat"), seqLengths, 1, nullptr));
+	}
+
+
+	// same as compute, but returns a list of up to numHypotheses tuples (label-string, optical score, textual score, score) per batch element, best first.
+	// The scores are log-probabilities if logDomain is set
+	std::vector<std::vector<std::tuple<std::vector<uint32_t>, double, double, double>>> computeNBest(const py::object& mat, size_t numHypotheses, const std::vector<int64_t>& seqLengths) const
+	{
+		if (numHypotheses == 0)
+		{
+			throw std::invalid_argument("the number of hypotheses (num_hypotheses) must be at least 1");
+		}
+
+		const auto hyps = decode(toArray(mat, "mat"), seqLengths, numHypotheses, nullptr);
+		std::vector<std::vector<std::tuple<std::vector<uint32_t>, double, double, double>>> res(hyps.size());
+		for (size_t b = 0; b < hyps.size(); ++b)
+		{
+			for (const auto& hyp : hyps[b])
+			{
+				res[b].push_back(std::make_tuple(hyp.text, hyp.opticalScore, hyp.textualScore, hyp.score));
+			}
+		}
+		return res;
+	}
+
+
+	// same as compute, additionally returns the decoding time of each batch element in seconds
+	std::pair<std::vector<std::vector<uint32_t>>, std::vector<double>> computeWithTimes(const py::object& mat, const std::vector<int64_t>& seqLengths) const
+	{
+		std::vector<double> times;
+		auto res = getBestTexts(decode(toArray(mat, "mat"), seqLengths, 1, &times));
+		return std::make_pair(std::move(res), std::move(times));
+	}
+
+
+	// same as compute, additionally returns a dict with the decoding statistics (counters and timers) of each batch element.
+	// Statistics are only collected if the module is compiled with WBS_STATS
+	std::pair<std::vector<std::vector<uint32_t>>, std::vector<py::dict>> computeWithStats(const py::object& mat, const std::vector<int64_t>& seqLengths) const
+	{
+		if (!DecodeStats::isEnabled())
+		{
+			throw std::runtime_error("decoding statistics are not available, build the module with the environment variable WBS_STATS=1");
+		}
+
+		std::vector<DecodeStats> stats;
+		auto res = getBestTexts(decode(toArray(mat, "mat"), seqLengths, 1, nullptr, &stats));
+		std::vector<py::dict> statsDicts;
+		for (const auto& s : stats)
+		{
+			py::dict d;
+			d["time_steps"] = s.timeSteps;
+			d["blank_frames"] = s.blankFrames;
+			d["beams_expanded"] = s.beamsExpanded;
+			d["candidates"] = s.candidates;
+			d["merges"] = s.merges;
+			d["trie_walks"] = s.trieWalks;
+			d["next_words_calls"] = s.nextWordsCalls;
+			d["next_words_enumerated"] = s.nextWordsEnumerated;
+			d["lm_lookups"] = s.lmLookups;
+			d["expansion_time"] = s.expansionTime;
+			d["selection_time"] = s.selectionTime;
+			d["lm_time"] = s.lmTime;
+			statsDicts.push_back(d);
+		}
+		return std::make_pair(std::move(res), std::move(statsDicts));
+	}
+
+
+	// create decoder for an input given in chunks of time-steps, it uses the LM and settings of this object
+	std::unique_ptr<NPStreamDecoder> createStream() const
+	{
+		return std::unique_ptr<NPStreamDecoder>(new NPStreamDecoder(m_lm, m_lmType, m_beamWidth, m_logDomain, m_pruning, m_numChars));
+	}
+
+
+private:
+	// best label-string of each batch element
+	static std::vector<std::vector<uint32_t>> getBestTexts(std::vector<std::vector<Hypothesis>>&& hyps)
+	{
+		std::vector<std::vector<uint32_t>> res(hyps.size());
+		for (size_t b = 0; b < hyps.size(); ++b)
+		{
+			res[b] = std::move(hyps[b][0].text);
+		}
+		return res;
+	}
+
+
+	// decode all batch elements into up to numHypotheses hypotheses each, write decoding times and statistics to times and stats if given.
+	// Other element types than float32 and float64 are converted to a float64 copy
+	std::vector<std::vector<Hypothesis>> decode(const py::array& array, const std::vector<int64_t>& seqLengths, size_t numHypotheses, std::vector<double>* times, std::vector<DecodeStats>* stats = nullptr) const
+	{
+		if (isReadableAs<float>(array))
+		{
+			return decode<float>(array, seqLengths, numHypotheses, times, stats);
+		}
+		if (isReadableAs<double>(array))
+		{
+			return decode<double>(array, seqLengths, numHypotheses, times, stats);
+		}
+
+		// ensure clears the Python error if the conversion fails
+		const auto converted = py::array_t<double, py::array::c_style | py::array::forcecast>::ensure(array);
+		if (!converted)
+		{
+			throw py::type_error("the input tensor (mat) must be convertible to a float64 array");
+		}
+		return decode<double>(converted, seqLengths, numHypotheses, times, stats);
+	}
+
+
+	// decode all batch elements of an array with element type T
+	template<class T>
+	std::vector<std::vector<Hypothesis>> decode(const py::array& array, const std::vector<int64_t>& seqLengths, size_t numHypotheses, std::vector<double>* times, std::vector<DecodeStats>* stats) const
+	{
+		if (array.ndim() != 3)
+		{
+			throw std::invalid_argument("the input tensor (mat) must have 3 dimensions (TxBxC)");
+		}
+		const size_t maxT = array.shape(0);
+		const size_t maxB = array.shape(1);
+		const size_t maxC = array.shape(2);
+
+		// strides in elements instead of bytes
+		const ptrdiff_t strideT = array.strides(0) / py::ssize_t(sizeof(T));
+		const ptrdiff_t strideB = array.strides(1) / py::ssize_t(sizeof(T));
+		const ptrdiff_t strideC = array.strides(2) / py::ssize_t(sizeof(T));
+		const T* data = static_cast<const T*>(array.data());
 
 		// check tensor size
 		if (maxC != m_numChars + 1)
@@ -83,15 +377,44 @@ public:
 			throw std::invalid_argument("the number of characters (chars) plus 1  must equal dimension 2 of the input tensor (mat)");
 		}
 
-		// go over all batch elements
-		std::vector<std::vector<uint32_t>> res;
-		for (size_t b = 0; b < maxB; ++b)
+		// number of time-steps to decode per batch element, all time-steps if no lengths are given
+		std::vector<size_t> numT(maxB, maxT);
+		if (!seqLengths.empty())
 		{
-			// wrapper around Tensor
-			MatrixArray mat(array, b, maxT, maxC);
+			if (seqLengths.size() != maxB)
+			{
+				throw std::invalid_argument("the number of sequence lengths (seq_lengths) must equal dimension 1 of the input tensor (mat)");
+			}
+			for (size_t b = 0; b < maxB; ++b)
+			{
+				if (seqLengths[b] < 0 || size_t(seqLengths[b]) > maxT)
+				{
+					throw std::invalid_argument("sequence lengths (seq_lengths) must be between 0 and dimension 0 of the input tensor (mat)");
+				}
+				numT[b] = size_t(seqLengths[b]);
+			}
+		}
 
-			// apply decoding algorithm to batch element 
-			res.push_back(wordBeamSearch(mat, m_beamWidth, m_lm, m_lmType));
+		// decode batch elements in parallel: each thread takes the next batch element which is not decoded yet.
+		// The LM is only read and each thread has its own beam arena
+		std::vector<std::vector<Hypothesis>> res(maxB);
+		if (stats)
+		{
+			stats->assign(maxB, DecodeStats());
+		}
+		{
+			py::gil_scoped_release release;
+			m_threadPool->parallelFor(maxB, [&](size_t b)
+			{
+				// collect statistics of this batch element if requested
+				DecodeStats::Collect collect(stats ? &(*stats)[b] : nullptr);
+
+				// view of batch element, elements are read directly from the memory of the array, so no GIL is needed
+				const auto mat = MatrixView<T>::fromBatch(data, b, numT[b], maxC, strideT, strideB, strideC);
+
+				// apply decoding algorithm to batch element 
+				res[b] = wordBeamSearchNBest(mat, m_beamWidth, numHypotheses, m_lm, m_lmType, m_logDomain, m_pruning);
+			}, times);
 		}
 
 		return res;
@@ -101,8 +424,21 @@ public:
 
 // register C++ class "NPWordBeamSearch" as "WordBeamSearch" in Python
 PYBIND11_MODULE(word_beam_search, m) {
+	py::class_<NPStreamDecoder>(m, "WordBeamSearchStream")
+		.def("push", &NPStreamDecoder::push, py::arg("frames"))
+		.def("partial", &NPStreamDecoder::partial)
+		.def("finalize", &NPStreamDecoder::finalize)
+		.def("reset", &NPStreamDecoder::reset)
+		.def_property_readonly("num_frames", &NPStreamDecoder::getNumFrames);
+
 	py::class_<NPWordBeamSearch>(m, "WordBeamSearch")
-		.def(py::init<size_t, std::string, float, const std::string&, const std::string&, const std::string&>())
-		.def("compute", &NPWordBeamSearch::compute);
+		.def(py::init<size_t, std::string, float, const std::string&, const std::string&, const std::string&, bool, size_t, double, size_t, double>(), py::arg("beam_width"), py::arg("lm_type"), py::arg("lm_smoothing"), py::arg("corpus"), py::arg("chars"), py::arg("word_chars"), py::arg("log_domain") = false, py::arg("num_threads") = 1, py::arg("prune_min_prob") = 0.0, py::arg("prune_top_n") = 0, py::arg("blank_threshold") = 0.0)
+		.def(py::init<size_t, std::string, const std::string&, bool, size_t, double, size_t, double>(), py::arg("beam_width"), py::arg("lm_type"), py::arg("lm_file"), py::arg("log_domain") = false, py::arg("num_threads") = 1, py::arg("prune_min_prob") = 0.0, py::arg("prune_top_n") = 0, py::arg("blank_threshold") = 0.0)
+		.def("compute", &NPWordBeamSearch::compute, py::arg("mat"), py::arg("seq_lengths") = std::vector<int64_t>())
+		.def("compute_nbest", &NPWordBeamSearch::computeNBest, py::arg("mat"), py::arg("num_hypotheses"), py::arg("seq_lengths") = std::vector<int64_t>())
+		.def("compute_with_times", &NPWordBeamSearch::computeWithTimes, py::arg("mat"), py::arg("seq_lengths") = std::vector<int64_t>())
+		.def("compute_with_stats", &NPWordBeamSearch::computeWithStats, py::arg("mat"), py::arg("seq_lengths") = std::vector<int64_t>())
+		.def("create_stream", &NPWordBeamSearch::createStream)
+		.def("save_lm", &NPWordBeamSearch::saveLm, py::arg("lm_file"));
 }
 
@@ -5,6 +5,9 @@
 
 PrefixTree::PrefixTree()
 :m_root(std::make_shared<Node>())
+,m_nodes(std::vector<FlatNode>(1))
+,m_labels(std::vector<uint32_t>(1, 0))
+,m_wordOffsets(std::vector<uint32_t>(1, 0))
 {
 }
 
@@ -28,9 +31,10 @@ void PrefixTree::addWord(const std::vector<uint32_t>& word)
 			node = iter->second;
 		}
 
+		// words get their ids and labels when all words are added
 		if (i + 1 == len)
 		{
-			node->word = word;
+			node->isWord = true;
 		}
 	}
 }
@@ -47,13 +51,18 @@ void PrefixTree::addWords(const std::vector<std::vector<uint32_t>>& words)
 
 void PrefixTree::allWordsAdded()
 {
-	std::deque<std::shared_ptr<Node>> nodes = { m_root };
-	while (!nodes.empty())
+	// copy nodes in breadth-first order into the compact tree, children get sorted by label to allow binary search
+	std::vector<FlatNode> nodes(1);
+	std::vector<uint32_t> labels(1, 0);
+	std::deque<Node*> queue = { m_root.get() };
+	size_t nodeIdx = 0;
+	while (!queue.empty())
 	{
 		// current node
-		auto& node = nodes.front();
+		Node* node = queue.front();
+		queue.pop_front();
 
-		// sort children by label to allow binary search
+		// sort children by label
 		std::sort
 		(
 			node->children.begin()
@@ -61,125 +70,261 @@ void PrefixTree::allWordsAdded()
 			,[](const std::pair<uint32_t, std::shared_ptr<Node>>& lhs, const std::pair<uint32_t, std::shared_ptr<Node>>& rhs) {return lhs.first < rhs.first; }
 		);
 
-		// go over all child nodes
+		// children are appended to the node array, they are visited in the same order later on
+		FlatNode& flatNode = nodes[nodeIdx];
+		flatNode.firstChild = static_cast<uint32_t>(nodes.size());
+		flatNode.numChildren = static_cast<uint32_t>(node->children.size());
+		flatNode.wordId = node->isWord ? 0 : invalidId;
 		for (const auto& kv : node->children)
 		{
-			// add node
-			nodes.push_back(kv.second);
+			nodes.push_back(FlatNode());
+			labels.push_back(kv.first);
+			queue.push_back(kv.second.get());
 		}
 
-		// remove current node from queue
-		nodes.pop_front();
+		++nodeIdx;
 	}
+
+	// the pointer-based tree is not needed anymore
+	m_root = std::make_shared<Node>();
+
+	// words get ids in depth-first order
+	std::vector<uint32_t> wordLabels;
+	std::vector<uint32_t> wordOffsets;
+	numberWords(nodes, labels, wordLabels, wordOffsets);
+	nodes.shrink_to_fit();
+	labels.shrink_to_fit();
+	wordLabels.shrink_to_fit();
+	wordOffsets.shrink_to_fit();
+	m_nodes = DataArray<FlatNode>(std::move(nodes));
+	m_labels = DataArray<uint32_t>(std::move(labels));
+	m_wordLabels = DataArray<uint32_t>(std::move(wordLabels));
+	m_wordOffsets = DataArray<uint32_t>(std::move(wordOffsets));
 }
 
 
-bool PrefixTree::isWord(const std::vector<uint32_t>& text) const
+PrefixTree::NodeId PrefixTree::getChild(NodeId node, uint32_t c) const
 {
-	std::shared_ptr<Node> node = getNode(text);
-	if (!node)
+	if (node == invalidId)
+	{
+		return invalidId;
+	}
+
+	// find child element representing the char (binary search)
+	const uint32_t* begin = m_labels.begin() + m_nodes[node].firstChild;
+	const uint32_t* end = begin + m_nodes[node].numChildren;
+	const uint32_t* iter = std::lower_bound(begin, end, c);
+	if (iter == end || *iter != c)
 	{
-		return false;
+		// not found
+		return invalidId;
 	}
 
-	return !node->word.empty();
+	return static_cast<NodeId>(iter - m_labels.begin());
 }
 
 
-std::vector<uint32_t> PrefixTree::getNextChars(const std::vector<uint32_t>& text) const
+bool PrefixTree::isWord(NodeId node) const
 {
-	std::vector<uint32_t> res;
-	std::shared_ptr<Node> node = getNode(text);
-	if (!node)
+	return node != invalidId && m_nodes[node].wordId != invalidId;
+}
+
+
+void PrefixTree::getNextChars(NodeId node, std::vector<uint32_t>& res) const
+{
+	res.clear();
+	if (node == invalidId)
 	{
-		return res;
+		return;
 	}
 
-	for (const auto kv : node->children)
+	const uint32_t* begin = m_labels.begin() + m_nodes[node].firstChild;
+	res.assign(begin, begin + m_nodes[node].numChildren);
+}
+
+
+std::vector<std::vector<uint32_t>> PrefixTree::getNextWords(NodeId node) const
+{
+	// all words starting with the prefix represented by the node
+	std::vector<std::vector<uint32_t>> res;
+	const auto wordIds = getNextWordIds(node);
+	for (uint32_t wordId = wordIds.first; wordId < wordIds.second; ++wordId)
 	{
-		res.push_back(kv.first);
+		res.push_back(getWord(wordId));
 	}
 
 	return res;
 }
 
 
-std::vector<std::vector<uint32_t>> PrefixTree::getNextWords(const std::vector<uint32_t>& text) const
+std::pair<uint32_t, uint32_t> PrefixTree::getNextWordIds(NodeId node) const
 {
-	// search start node, that is the node representing the given prefix
-	std::vector<std::vector<uint32_t>> res;
-	const auto startNode = getNode(text);
-	if (!startNode)
+	if (node == invalidId)
 	{
-		return res;
+		return std::make_pair(0u, 0u);
 	}
 
-	// cache for level 1
-	const bool isLevel1 = text.size() == 1;
-	if (isLevel1)
+	return std::make_pair(m_nodes[node].firstWord, m_nodes[node].endWord);
+}
+
+
+uint32_t PrefixTree::getWordId(NodeId node) const
+{
+	return node == invalidId ? invalidId : m_nodes[node].wordId;
+}
+
+
+std::pair<const uint32_t*, const uint32_t*> PrefixTree::getWordLabels(uint32_t wordId) const
+{
+	const uint32_t* labels = m_wordLabels.data();
+	return std::make_pair(labels + m_wordOffsets[wordId], labels + m_wordOffsets[wordId + 1]);
+}
+
+
+bool PrefixTree::isWord(const std::vector<uint32_t>& text) const
+{
+	return isWord(getNode(text));
+}
+
+
+std::vector<uint32_t> PrefixTree::getNextChars(const std::vector<uint32_t>& text) const
+{
+	std::vector<uint32_t> res;
+	getNextChars(getNode(text), res);
+	return res;
+}
+
+
+void PrefixTree::getNextChars(const std::vector<uint32_t>& text, std::vector<uint32_t>& res) const
+{
+	getNextChars(getNode(text), res);
+}
+
+
+std::vector<std::vector<uint32_t>> PrefixTree::getNextWords(const std::vector<uint32_t>& text) const
+{
+	return getNextWords(getNode(text));
+}
+
+
+size_t PrefixTree::getMemoryUsage() const
+{
+	return m_nodes.getMemoryUsage() + m_labels.getMemoryUsage() + m_wordLabels.getMemoryUsage() + m_wordOffsets.getMemoryUsage();
+}
+
+
+void PrefixTree::write(BinaryWriter& writer) const
+{
+	writer.writeArray(m_nodes);
+	writer.writeArray(m_labels);
+	writer.writeArray(m_wordLabels);
+	writer.writeArray(m_wordOffsets);
+}
+
+
+void PrefixTree::read(BinaryReader& reader, size_t numChars)
+{
+	m_root = std::make_shared<Node>();
+	m_nodes = reader.readArray<FlatNode>();
+	m_labels = reader.readArray<uint32_t>();
+	m_wordLabels = reader.readArray<uint32_t>();
+	m_wordOffsets = reader.readArray<uint32_t>();
+
+	// check sizes and contents, so that the queries stay inside of the arrays and labels are valid columns of the matrix
+	if (m_nodes.empty() || m_labels.size() != m_nodes.size() || m_wordOffsets.empty() || m_wordOffsets[0] != 0 || m_wordOffsets[m_wordOffsets.size() - 1] != m_wordLabels.size())
+	{
+		throw std::runtime_error("binary file is corrupt: inconsistent prefix tree");
+	}
+	const size_t numWords = getNumWords();
+	for (size_t i = 0; i < numWords; ++i)
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
-		const auto cacheIter = m_level1Cache.find(text[0]);
-		if (cacheIter != m_level1Cache.end())
+		if (m_wordOffsets[i] > m_wordOffsets[i + 1])
 		{
-			return cacheIter->second;
+			throw std::runtime_error("binary file is corrupt: word offsets of prefix tree are not sorted");
 		}
 	}
-
-	// search all words starting with the given prefix
-	std::deque<std::shared_ptr<Node>> nodes = { startNode };
-	while (!nodes.empty())
+	for (size_t i = 0; i < m_nodes.size(); ++i)
 	{
-		// current node
-		const auto& node = nodes.front();
-
-		// go over all child nodes
-		for (const auto& kv : node->children)
+		const FlatNode& node = m_nodes[i];
+		if (uint64_t(node.firstChild) + node.numChildren > m_nodes.size()
+			|| (node.wordId != invalidId && node.wordId >= numWords)
+			|| node.firstWord > node.endWord || node.endWord > numWords
+			|| (i > 0 && m_labels[i] >= numChars)) // the root has no label
 		{
-			// add node
-			nodes.push_back(kv.second);
+			throw std::runtime_error("binary file is corrupt: invalid node of prefix tree");
 		}
-
-		// remember current prefix if it is a word
-		if (!node->word.empty())
+	}
+	for (const auto label : m_wordLabels)
+	{
+		if (label >= numChars)
 		{
-			res.push_back(node->word);
+			throw std::runtime_error("binary file is corrupt: invalid label of prefix tree");
 		}
-
-		// remove current node from queue
-		nodes.pop_front();
 	}
+}
+
 
-	// put result for level 1 into cache
-	if (isLevel1)
+PrefixTree::NodeId PrefixTree::getNode(const std::vector<uint32_t>& text) const
+{
+	// start with root and follow the chars of the text
+	NodeId node = getRoot();
+	for (const auto c : text)
 	{
-		std::lock_guard<std::mutex> lock(m_mutex);
-		m_level1Cache[text[0]] = res;
+		node = getChild(node, c);
 	}
 
-	return res;
+	return node;
 }
 
 
-std::shared_ptr<PrefixTree::Node> PrefixTree::getNode(const std::vector<uint32_t>& text) const
+std::vector<uint32_t> PrefixTree::getWord(uint32_t wordId) const
 {
-	// start with root
-	std::shared_ptr<Node> node = m_root;
-	for (const auto c : text)
+	const auto labels = getWordLabels(wordId);
+	return std::vector<uint32_t>(labels.first, labels.second);
+}
+
+
+void PrefixTree::numberWords(std::vector<FlatNode>& nodes, const std::vector<uint32_t>& labels, std::vector<uint32_t>& wordLabels, std::vector<uint32_t>& wordOffsets)
+{
+	// depth-first traversal: a node gets its word id before its children, children are visited in the order of their labels.
+	// The labels of a word are the labels on the path from the root to its node
+	wordLabels.clear();
+	wordOffsets.assign(1, 0);
+	std::vector<uint32_t> path;
+	std::vector<std::pair<NodeId, uint32_t>> stack; // node and index of its next child to visit
+	stack.push_back(std::make_pair(0u, 0u));
+	while (!stack.empty())
 	{
-		// find child element representing current char (binary search)
-		auto iter = std::lower_bound(node->children.begin(), node->children.end(), c, [](const std::pair<uint32_t, std::shared_ptr<Node>>& p, uint32_t val) {return p.first < val; });
-		if (iter == node->children.end() || iter->first > c)
+		FlatNode& node = nodes[stack.back().first];
+
+		// first visit of node: assign new id to the word of the node
+		if (stack.back().second == 0)
 		{
-			// not found
-			return std::shared_ptr<PrefixTree::Node>();
+			node.firstWord = static_cast<uint32_t>(wordOffsets.size() - 1);
+			if (node.wordId != invalidId)
+			{
+				wordLabels.insert(wordLabels.end(), path.begin(), path.end());
+				wordOffsets.push_back(static_cast<uint32_t>(wordLabels.size()));
+				node.wordId = node.firstWord;
+			}
 		}
 
-		// continue with the child node
-		node = iter->second;
+		// visit next child, or finish node if all children are visited
+		if (stack.back().second < node.numChildren)
+		{
+			const NodeId child = node.firstChild + stack.back().second;
+			++stack.back().second;
+			stack.push_back(std::make_pair(child, 0u));
+			path.push_back(labels[child]);
+		}
+		else
+		{
+			node.endWord = static_cast<uint32_t>(wordOffsets.size() - 1);
+			stack.pop_back();
+			if (!path.empty())
+			{
+				path.pop_back();
+			}
+		}
 	}
-
-	return node;
 }
-
-
@@ -1,8 +1,8 @@
 #pragma once
+#include "DataArray.hpp"
+#include "BinaryFile.hpp"
 #include <vector>
 #include <memory>
-#include <map>
-#include <mutex>
 #include <stdint.h>
 #include <cstddef>
 
@@ -19,22 +19,65 @@ public:
 	void addWords(const std::vector<std::vector<uint32_t>>& words);
 	void allWordsAdded();
 
-	// query prefix tree
+	// node handle for incremental queries: start with getRoot() and advance by one char with getChild()
+	typedef uint32_t NodeId;
+	static const uint32_t invalidId = 0xffffffff; // invalid node or word
+	NodeId getRoot() const { return 0; }
+	NodeId getChild(NodeId node, uint32_t c) const;
+	NodeId getNode(const std::vector<uint32_t>& text) const; // get the node for a given text, invalidId if not found
+
+	// query prefix tree for the text represented by a node, an invalid node gives an empty result
+	bool isWord(NodeId node) const;
+	void getNextChars(NodeId node, std::vector<uint32_t>& res) const; // result written to res, reuses its memory
+	std::vector<std::vector<uint32_t>> getNextWords(NodeId node) const;
+
+	// words are numbered in depth-first order, so the words starting with the text of a node have contiguous ids.
+	// This allows iterating over the next words of a node without copying them
+	std::pair<uint32_t, uint32_t> getNextWordIds(NodeId node) const; // id range [first, end), empty for an invalid node
+	uint32_t getWordId(NodeId node) const; // invalidId if the node does not represent a word
+	size_t getNumWords() const { return m_wordOffsets.size() - 1; }
+	std::pair<const uint32_t*, const uint32_t*> getWordLabels(uint32_t wordId) const; // labels [begin, end) of the word
+	std::vector<uint32_t> getWord(uint32_t wordId) const;
+
+	// query prefix tree for a text
 	bool isWord(const std::vector<uint32_t>& text) const;
 	std::vector<uint32_t> getNextChars(const std::vector<uint32_t>& text) const;
+	void getNextChars(const std::vector<uint32_t>& text, std::vector<uint32_t>& res) const; // result written to res, reuses its memory
 	std::vector<std::vector<uint32_t>> getNextWords(const std::vector<uint32_t>& text) const;
 
+	// number of bytes used by the search structures
+	size_t getMemoryUsage() const;
+
+	// write search structures to file, read them from a mapped file without copying them.
+	// Reading throws std::runtime_error if the structures are inconsistent or contain labels >= numChars
+	void write(BinaryWriter& writer) const;
+	void read(BinaryReader& reader, size_t numChars);
 
 private:
-	// node of the prefix tree
+	// node of the prefix tree while words are added
 	struct Node
 	{
 		std::vector<std::pair<uint32_t, std::shared_ptr<Node>>> children;
-		std::vector<uint32_t> word;
+		bool isWord = false;
 	};
 
-	std::shared_ptr<Node> m_root; // the root represents the empty text
-	std::shared_ptr<Node> getNode(const std::vector<uint32_t>& text) const; // get the node for a given text
-	mutable std::map<uint32_t, std::vector<std::vector<uint32_t>>> m_level1Cache; // cache words of nodes in level 1
-	mutable std::mutex m_mutex;
+	// node of the compact prefix tree. Nodes are stored in breadth-first order,
+	// therefore the children of a node are stored contiguously, sorted by their labels.
+	// The layout is stored in files as it is
+	struct FlatNode
+	{
+		uint32_t firstChild = 0; // index of first child in m_nodes
+		uint32_t numChildren = 0;
+		uint32_t wordId = invalidId; // word represented by this node, invalidId if prefix is not a word
+		uint32_t firstWord = 0; // words of this node and its descendants have ids [firstWord, endWord)
+		uint32_t endWord = 0;
+	};
+
+	std::shared_ptr<Node> m_root; // the root represents the empty text, only used while words are added
+	DataArray<FlatNode> m_nodes; // root is m_nodes[0]
+	DataArray<uint32_t> m_labels; // label of the edge from the parent to node i
+	DataArray<uint32_t> m_wordLabels; // labels of all words, concatenated
+	DataArray<uint32_t> m_wordOffsets; // word i is given by m_wordLabels[m_wordOffsets[i]...m_wordOffsets[i+1]]
+
+	static void numberWords(std::vector<FlatNode>& nodes, const std::vector<uint32_t>& labels, std::vector<uint32_t>& wordLabels, std::vector<uint32_t>& wordOffsets);
 };
@@ -0,0 +1,47 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+
+
+// arithmetic on probabilities, which are represented either as raw probabilities or as log-probabilities.
+// The log-domain avoids underflow for long inputs and replaces pow() by a division
+class ProbDomain
+{
+public:
+	// CTOR
+	explicit ProbDomain(bool logDomain = false) :m_logDomain(logDomain) {}
+	bool isLogDomain() const { return m_logDomain; }
+
+	// probability 0 and 1
+	double zero() const { return m_logDomain ? -std::numeric_limits<double>::infinity() : 0.0; }
+	double one() const { return m_logDomain ? 0.0 : 1.0; }
+
+	// map between raw probability and this domain
+	double fromProb(double pr) const { return m_logDomain ? std::log(pr) : pr; }
+	double toProb(double val) const { return m_logDomain ? std::exp(val) : val; }
+
+	// product and sum of probabilities (sum in log-domain is log-sum-exp)
+	double mul(double a, double b) const { return m_logDomain ? a + b : a*b; }
+	double add(double a, double b) const
+	{
+		if (!m_logDomain)
+		{
+			return a + b;
+		}
+
+		const double maxVal = std::max(a, b);
+		if (maxVal == zero())
+		{
+			return maxVal;
+		}
+		return maxVal + std::log1p(std::exp(std::min(a, b) - maxVal));
+	}
+
+	// n-th root of probability (geometric mean of n probabilities)
+	double root(double val, size_t n) const { return m_logDomain ? val / n : std::pow(val, 1.0 / n); }
+
+private:
+	bool m_logDomain = false;
+};
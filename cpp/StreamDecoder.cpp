@@ -0,0 +1,273 @@
+#include "StreamDecoder.hpp"
+#include "DecodeStats.hpp"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+
+namespace
+{
+	// smallest score (in the domain of the beams) a char of the time-step must have to extend beams, the blank is not considered
+	double getMinCharScore(const std::vector<double>& row, const CharPruning& pruning, const ProbDomain& domain, std::vector<double>& scores)
+	{
+		double minScore = domain.fromProb(pruning.minProb);
+		const size_t numChars = row.size() - 1;
+		if (pruning.topN > 0 && pruning.topN < numChars)
+		{
+			// score of the topN-th best char
+			scores.assign(row.begin(), row.begin() + numChars);
+			std::nth_element(scores.begin(), scores.begin() + (pruning.topN - 1), scores.end(), std::greater<double>());
+			minScore = std::max(minScore, scores[pruning.topN - 1]);
+		}
+		return minScore;
+	}
+}
+
+
+StreamDecoder::StreamDecoder(const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, size_t beamWidth, bool logDomain, const CharPruning& pruning)
+:m_lm(lm)
+,m_lmType(lmType)
+,m_beamWidth(beamWidth)
+,m_domain(logDomain)
+,m_pruning(pruning)
+,m_ownArena(new BeamArena)
+,m_arena(*m_ownArena)
+,m_last(m_arena)
+,m_curr(m_arena)
+{
+	reset();
+}
+
+
+StreamDecoder::StreamDecoder(const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, size_t beamWidth, bool logDomain, const CharPruning& pruning, BeamArena& arena)
+:m_lm(lm)
+,m_lmType(lmType)
+,m_beamWidth(beamWidth)
+,m_domain(logDomain)
+,m_pruning(pruning)
+,m_arena(arena)
+,m_last(m_arena)
+,m_curr(m_arena)
+{
+	reset();
+}
+
+
+template<class T>
+void StreamDecoder::push(const MatrixView<T>& frames)
+{
+	if (m_numFrames > 0 && frames.cols() != m_row.size())
+	{
+		throw std::invalid_argument("all frames must have the same number of chars");
+	}
+
+	// select decoder of scoring mode once per chunk
+	switch (m_lmType)
+	{
+	case LanguageModelType::NGrams:
+		decodeFrames<T, LanguageModelType::NGrams>(frames);
+		break;
+	case LanguageModelType::NGramsForecast:
+		decodeFrames<T, LanguageModelType::NGramsForecast>(frames);
+		break;
+	case LanguageModelType::NGramsForecastAndSample:
+		decodeFrames<T, LanguageModelType::NGramsForecastAndSample>(frames);
+		break;
+	default:
+		decodeFrames<T, LanguageModelType::Words>(frames);
+		break;
+	}
+	m_numFrames += frames.rows();
+}
+
+
+std::vector<uint32_t> StreamDecoder::partial()
+{
+	return m_last.getBestBeams(1)[0]->getText();
+}
+
+
+std::vector<uint32_t> StreamDecoder::finalize()
+{
+	return finalizeNBest(1)[0].text;
+}
+
+
+std::vector<Hypothesis> StreamDecoder::finalizeNBest(size_t numHypotheses)
+{
+	// texts may become equal when completed, so all beams are ranked if more than one hypothesis is requested.
+	// Completing the texts changes the beams, which is fine as the list is reset afterwards
+	std::vector<Hypothesis> res;
+	std::vector<const TextNode*> texts;
+	for (const auto beam : m_last.getBestBeams(numHypotheses > 1 ? std::numeric_limits<size_t>::max() : numHypotheses))
+	{
+		if (res.size() == numHypotheses)
+		{
+			break;
+		}
+
+		beam->completeText();
+		const TextNode* text = beam->getTextNode();
+		if (std::any_of(texts.begin(), texts.end(), [&](const TextNode* other) { return TextNodeEqual()(text, other); }))
+		{
+			continue;
+		}
+		texts.push_back(text);
+
+		Hypothesis hyp;
+		hyp.text = beam->getText();
+		hyp.opticalScore = beam->getTotalProb();
+		hyp.textualScore = beam->getTextualProb();
+		hyp.score = beam->getScore();
+		res.push_back(std::move(hyp));
+	}
+	reset();
+	return res;
+}
+
+
+void StreamDecoder::reset()
+{
+	// start with genesis beam
+	m_last.clear();
+	m_curr.clear();
+	m_last.addBeam(m_arena.createBeam(*m_lm, m_domain.isLogDomain()));
+	m_numFrames = 0;
+}
+
+
+template<class T, LanguageModelType lmType>
+void StreamDecoder::decodeFrames(const MatrixView<T>& frames)
+{
+	// dim0: T, dim1: C
+	const size_t numT = frames.rows();
+	const size_t maxC = frames.cols();
+	const size_t blank = maxC - 1;
+	m_row.resize(maxC);
+
+	// char probabilities of a time step, mapped to log-domain only once per char
+	const ptrdiff_t colStride = frames.colStride();
+	auto loadRow = [&](size_t t)
+	{
+		const T* matRow = frames.row(t);
+		for (size_t c = 0; c < maxC; ++c)
+		{
+			m_row[c] = m_domain.fromProb(matRow[static_cast<ptrdiff_t>(c) * colStride]);
+		}
+	};
+
+	// in a blank frame no char extends the beams
+	auto isBlankFrame = [&](size_t t)
+	{
+		return m_pruning.blankThreshold > 0.0 && frames.getAt(t, blank) >= m_pruning.blankThreshold;
+	};
+
+	// go over all time steps
+	for (size_t t = 0; t < numT; ++t)
+	{
+		loadRow(t);
+		WBS_STATS_ADD(timeSteps, 1);
+
+		// a run of blank frames only updates the optical scores of the beams, so no beams are created or merged until the run ends.
+		// The beams stay the same, therefore each beam gets only one child beam for the whole run
+		if (isBlankFrame(t))
+		{
+			WBS_STATS_TIMER(selectionTimer, selectionTime);
+			const std::vector<Beam*>& bestBeams = m_last.getBestBeams(m_beamWidth);
+			WBS_STATS_STOP(selectionTimer);
+			WBS_STATS_TIMER(expansionTimer, expansionTime);
+			m_runScores.clear();
+			for (const auto beam : bestBeams)
+			{
+				m_runScores.push_back(std::make_pair(beam->getBlankProb(), beam->getNonBlankProb()));
+			}
+
+			while (true)
+			{
+				WBS_STATS_ADD(blankFrames, 1);
+				for (size_t i = 0; i < bestBeams.size(); ++i)
+				{
+					auto& scores = m_runScores[i];
+					const double prTotal = m_domain.add(scores.first, scores.second);
+					scores.second = bestBeams[i]->getTextLength() == 0 ? m_domain.zero() : m_domain.mul(scores.second, m_row[bestBeams[i]->getLastChar()]);
+					scores.first = m_domain.mul(prTotal, m_row[blank]);
+				}
+
+				if (t + 1 == numT || !isBlankFrame(t + 1))
+				{
+					break;
+				}
+				loadRow(++t);
+				WBS_STATS_ADD(timeSteps, 1);
+			}
+
+			for (size_t i = 0; i < bestBeams.size(); ++i)
+			{
+				m_curr.addBeam(bestBeams[i]->createChildBeam(m_runScores[i].first, m_runScores[i].second));
+			}
+			WBS_STATS_STOP(expansionTimer);
+			m_last.clear();
+			m_last.swap(m_curr);
+			continue;
+		}
+
+		// chars with a lower score do not extend beams in this time step
+		const double minCharScore = m_pruning.isActive() ? getMinCharScore(m_row, m_pruning, m_domain, m_pruningScores) : m_domain.zero();
+
+		// get k best beams and iterate 
+		WBS_STATS_TIMER(selectionTimer, selectionTime);
+		const std::vector<Beam*>& bestBeams = m_last.getBestBeams(m_beamWidth);
+		WBS_STATS_STOP(selectionTimer);
+		WBS_STATS_ADD(beamsExpanded, bestBeams.size());
+		WBS_STATS_TIMER(expansionTimer, expansionTime);
+		for (const auto beam : bestBeams)
+		{
+			double prBlank=m_domain.zero(), prNonBlank=m_domain.zero();
+
+			// calc prob that path ends with a non-blank
+			prNonBlank = beam->getTextLength() == 0 ? m_domain.zero() : m_domain.mul(beam->getNonBlankProb(), m_row[beam->getLastChar()]);
+
+			// calc prob that path ends with a blank
+			prBlank = m_domain.mul(beam->getTotalProb(), m_row[blank]);
+		
+			// add copy of original beam to current time step
+			m_curr.addBeam(beam->createChildBeam(prBlank, prNonBlank));
+
+			// extend current beam
+			beam->getNextChars(m_nextChars);
+			for (const auto c : m_nextChars)
+			{
+				if (m_row[c] < minCharScore)
+				{
+					continue;
+				}
+
+				prBlank = m_domain.zero();
+				prNonBlank = m_domain.zero();
+				// last char in beam equals new char: path must end with blank
+				if (beam->getTextLength() != 0 && beam->getLastChar() == c)
+				{
+					prNonBlank = m_domain.mul(m_row[c], beam->getBlankProb());
+				}
+				// last char in beam and new char different
+				else
+				{
+					prNonBlank = m_domain.mul(m_row[c], beam->getTotalProb());
+				}
+
+				m_curr.addBeam(beam->createChildBeam<lmType>(prBlank, prNonBlank, c));
+			}
+		}
+		WBS_STATS_STOP(expansionTimer);
+
+		// beams of last time-step are not needed anymore
+		m_last.clear();
+		m_last.swap(m_curr);
+	}
+}
+
+
+// the decoder is compiled for float and double matrices
+template void StreamDecoder::push(const MatrixView<float>& frames);
+template void StreamDecoder::push(const MatrixView<double>& frames);
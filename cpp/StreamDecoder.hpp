@@ -0,0 +1,70 @@
+#pragma once
+#include "MatrixView.hpp"
+#include "LanguageModel.hpp"
+#include "Beam.hpp"
+#include "BeamArena.hpp"
+#include "WordBeamSearch.hpp"
+#include <vector>
+#include <memory>
+#include <utility>
+#include <stdint.h>
+#include <cstddef>
+
+
+// word beam search decoder which receives the time-steps of the input in chunks, e.g. for online recognition.
+// The beams are kept between the chunks, so the current best text is available after each chunk
+class StreamDecoder
+{
+public:
+	// CTOR: beams are allocated in an arena owned by the decoder
+	StreamDecoder(const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, size_t beamWidth, bool logDomain = false, const CharPruning& pruning = CharPruning());
+
+	// CTOR: beams are allocated in the given arena, which must outlive the decoder
+	StreamDecoder(const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, size_t beamWidth, bool logDomain, const CharPruning& pruning, BeamArena& arena);
+
+	StreamDecoder(const StreamDecoder&) = delete;
+	StreamDecoder& operator=(const StreamDecoder&) = delete;
+
+	// decode the next time-steps (rows of frames), frames must have the same number of columns (chars plus blank) each time
+	template<class T>
+	void push(const MatrixView<T>& frames);
+
+	// best text of the time-steps decoded so far, the last word may be incomplete
+	std::vector<uint32_t> partial();
+
+	// best text with its last word completed if there is only one word it can be completed to.
+	// The decoder is reset afterwards, so it can decode the next input
+	std::vector<uint32_t> finalize();
+
+	// same as finalize, but returns up to numHypotheses texts of the final beams with their scores, best first.
+	// Beams whose texts are equal after completion are only returned once
+	std::vector<Hypothesis> finalizeNBest(size_t numHypotheses);
+
+	// discard all decoded time-steps
+	void reset();
+
+	// number of time-steps decoded since the last reset
+	size_t getNumFrames() const { return m_numFrames; }
+
+private:
+	std::shared_ptr<LanguageModel> m_lm;
+	LanguageModelType m_lmType;
+	size_t m_beamWidth;
+	ProbDomain m_domain;
+	CharPruning m_pruning;
+	std::unique_ptr<BeamArena> m_ownArena; // only used if no arena is given
+	BeamArena& m_arena;
+	BeamList m_last; // beams after the last decoded time-step
+	BeamList m_curr;
+	size_t m_numFrames = 0;
+
+	// buffers reused across time-steps and chunks
+	std::vector<double> m_row;
+	std::vector<uint32_t> m_nextChars;
+	std::vector<double> m_pruningScores;
+	std::vector<std::pair<double, double>> m_runScores; // blank and non-blank score of each beam in a run of blank frames
+
+	// decode frames for one scoring mode, which is a template parameter so that the beams are extended without checking the mode
+	template<class T, LanguageModelType lmType>
+	void decodeFrames(const MatrixView<T>& frames);
+};
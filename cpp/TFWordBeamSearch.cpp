@@ -5,22 +5,34 @@
 #include <cctype>
 #include <memory>
 #include <exception>
-#include <thread>
 #include <cstddef>
 #include <stdint.h>
-#include "MatrixTensor.hpp"
+#include "MatrixView.hpp"
 #include "WordBeamSearch.hpp"
 #include "LanguageModel.hpp"
+#include "ThreadPool.hpp"
+#include "DecodeStats.hpp"
+#include "ProbDomain.hpp"
+
+
+// attributes shared by all ops
+#define WBS_ATTRS \
+.Attr("beamWidth: int") \
+.Attr("lmType: string") \
+.Attr("lmSmoothing: float") \
+.Attr("corpus: string") \
+.Attr("chars: string") \
+.Attr("wordChars: string") \
+.Attr("logDomain: bool = false") \
+.Attr("lmFile: string = ''") \
+.Attr("pruneMinProb: float = 0.0") \
+.Attr("pruneTopN: int = 0") \
+.Attr("blankThreshold: float = 0.0")
 
 
 REGISTER_OP("WordBeamSearch")
 .Input("mat: float32")
-.Attr("beamWidth: int")
-.Attr("lmType: string")
-.Attr("lmSmoothing: float")
-.Attr("corpus: string")
-.Attr("chars: string")
-.Attr("wordChars: string")
+WBS_ATTRS
 .Output("result: int32")
 .Doc(
 "Decodes matrix (mat) using a dictionary and language model created from text corpus (corpus). "\
@@ -28,7 +40,51 @@ REGISTER_OP("WordBeamSearch")
 "All characters (chars) must be passed in the same order as they appear in mat, not including the CTC-blank. "\
 "The characters (wordChars) which can occur in a word are used to create the dictionary and language model from the corpus. "\
 "The LM scoring mode (lmType) must be one of the following four strings (not case-sensitive): 'Words', 'NGrams', 'NGramsForecast', 'NGramsForecastAndSample'. "\
-"Pass strings UTF8 encoded if using special characters. "
+"Pass strings UTF8 encoded if using special characters. "\
+"If logDomain is set, scores are computed as log-probabilities which avoids underflow for long inputs. "\
+"If lmFile is set, the dictionary and language model are loaded from this binary file instead, and corpus, chars, wordChars and lmSmoothing are ignored. "\
+"Per time-step, chars with a probability below pruneMinProb or not among the pruneTopN most probable chars do not extend beams (0 disables pruning). "\
+"No char extends beams in time-steps with a blank probability of at least blankThreshold (0 disables it). "
+);
+
+
+REGISTER_OP("WordBeamSearchSeqLen")
+.Input("mat: float32")
+.Input("seqLen: int32")
+WBS_ATTRS
+.Output("result: int32")
+.Doc(
+"Same as WordBeamSearch, but batch element b is only decoded for its first seqLen[b] time-steps. "
+);
+
+
+// outputs of the N-best ops
+#define WBS_NBEST_OUTPUTS \
+.Attr("numHypotheses: int >= 1") \
+.Output("result: int32") \
+.Output("opticalScore: float64") \
+.Output("textualScore: float64") \
+.Output("score: float64")
+
+
+REGISTER_OP("WordBeamSearchNBest")
+.Input("mat: float32")
+WBS_ATTRS
+WBS_NBEST_OUTPUTS
+.Doc(
+"Same as WordBeamSearch, but outputs up to numHypotheses texts per batch element (BxNxT), taken from the final beams, best first. "\
+"The scores (BxN, float64, as computed by the decoder) are the optical score, the textual (LM) score and their product, which ranks the texts. They are log-probabilities if logDomain is set. "\
+"Texts which are equal after completing their last word are output once. Missing hypotheses are filled with blanks and a score of probability 0. "
+);
+
+
+REGISTER_OP("WordBeamSearchNBestSeqLen")
+.Input("mat: float32")
+.Input("seqLen: int32")
+WBS_ATTRS
+WBS_NBEST_OUTPUTS
+.Doc(
+"Same as WordBeamSearchNBest, but batch element b is only decoded for its first seqLen[b] time-steps. "
 );
 
 
@@ -43,6 +99,10 @@ private:
 	size_t m_beamWidth = 0;
 	size_t m_numChars = 0;
 	LanguageModelType m_lmType = LanguageModelType::Words;
+	bool m_logDomain = false;
+	CharPruning m_pruning;
+	size_t m_numHypotheses = 0; // 0 for the ops which only output the best text
+	std::unique_ptr<ThreadPool> m_threadPool; // decodes the batch elements in parallel, reused across calls
 
 public:
 	// CTOR
@@ -97,8 +157,50 @@ public:
 		std::string wordChars;
 		OP_REQUIRES_OK(context, context->GetAttr("wordChars", &wordChars));
 
-		// create language model
-		m_lm = std::make_shared<LanguageModel>(corpus, chars, wordChars, m_lmType, lmSmoothing);
+		// read if scores are computed in log-domain
+		OP_REQUIRES_OK(context, context->GetAttr("logDomain", &m_logDomain));
+
+		// read pruning of chars and blank frames per time-step
+		float pruneMinProb = 0.0f;
+		int64 pruneTopN = 0;
+		OP_REQUIRES_OK(context, context->GetAttr("pruneMinProb", &pruneMinProb));
+		OP_REQUIRES_OK(context, context->GetAttr("pruneTopN", &pruneTopN));
+		float blankThreshold = 0.0f;
+		OP_REQUIRES_OK(context, context->GetAttr("blankThreshold", &blankThreshold));
+		m_pruning = CharPruning(pruneMinProb, static_cast<size_t>(std::max(pruneTopN, int64(0))), blankThreshold);
+
+		// threads for parallel decoding
+#ifdef WBS_PARALLEL
+		m_threadPool.reset(new ThreadPool(WBS_THREADS));
+#else
+		m_threadPool.reset(new ThreadPool(1));
+#endif
+
+		// read number of hypotheses of the N-best ops
+		if(context->num_outputs() > 1)
+		{
+			int64 numHypotheses64 = 0;
+			OP_REQUIRES_OK(context, context->GetAttr("numHypotheses", &numHypotheses64));
+			m_numHypotheses = static_cast<size_t>(numHypotheses64);
+		}
+
+		// read path of binary LM file
+		std::string lmFile;
+		OP_REQUIRES_OK(context, context->GetAttr("lmFile", &lmFile));
+
+		// create language model, or load it from file
+		if(lmFile.empty())
+		{
+			m_lm = std::make_shared<LanguageModel>(corpus, chars, wordChars, m_lmType, lmSmoothing);
+		}
+		else
+		{
+			m_lm = LanguageModel::load(lmFile);
+			if(m_lmType != LanguageModelType::Words && !m_lm->hasBigrams())
+			{
+				throw std::invalid_argument("LM file (lmFile) was created for LM type Words and can not be used for N-grams");
+			}
+		}
 
 		// query number of chars (may be different to chars.size()) to check tensor shape
 		m_numChars = m_lm->getAllChars().size();
@@ -127,58 +229,26 @@ public:
 	}
 
 
-#ifdef WBS_PARALLEL
-	// split batch into groups of batch elements
-	std::vector<std::vector<size_t>> splitWork(size_t numThreads, size_t batchSize)
+	// fill hypotheses from decoder into output tensors, missing hypotheses get blanks and a score of probability 0
+	template<class U, class V>
+	void fillHypotheses(const std::vector<Hypothesis>& hyps, U& outputMapped, V& opticalMapped, V& textualMapped, V& scoreMapped, size_t batchElement, size_t maxT, size_t maxC)
 	{
-		std::vector<std::vector<size_t>> res(numThreads);
-
-		size_t div = batchSize / numThreads;
-		size_t rem = batchSize % numThreads;
-		size_t ctrF = 0;
-		size_t ctrB = batchSize - 1;
-		for(size_t th = 0; th < numThreads; ++th)
+		const size_t blank = maxC - 1;
+		const double zero = ProbDomain(m_logDomain).zero();
+		for(size_t n = 0; n < m_numHypotheses; ++n)
 		{
-			if(rem > 0)
+			const bool hasHyp = n < hyps.size();
+			for(size_t t = 0; t < maxT; ++t)
 			{
-				res[th].push_back(ctrB);
-				ctrB--;
-				rem--;
-			}
-
-			for(size_t i = 0; i < div; ++i)
-			{
-				res[th].push_back(ctrF);
-				ctrF++;
+				outputMapped(batchElement, n, t) = hasHyp && t < hyps[n].text.size() ? hyps[n].text[t] : blank;
 			}
+			opticalMapped(batchElement, n) = hasHyp ? hyps[n].opticalScore : zero;
+			textualMapped(batchElement, n) = hasHyp ? hyps[n].textualScore : zero;
+			scoreMapped(batchElement, n) = hasHyp ? hyps[n].score : zero;
 		}
-
-		return res;
 	}
-#endif
-
-
-#ifdef WBS_PARALLEL
-	// do the work for a group of batch elements
-	template<class U, class V>
-	void doWork(const U& inputMapped, V& outputMapped, const std::vector<std::vector<size_t>>& work, size_t threadIdx, size_t maxT, size_t maxC)
-	{
-		const std::vector<size_t>& batchElements = work[threadIdx];
-		for(auto b : batchElements)
-		{
-			// wrapper around Tensor
-			MatrixTensor<decltype(inputMapped)> mat(inputMapped, b, maxT, maxC);
 
-			// apply decoding algorithm to batch element 
-			const std::vector<uint32_t> decoded = wordBeamSearch(mat, m_beamWidth, m_lm, m_lmType);
-			
-			// write to output tensor
-			fillResult(decoded, outputMapped, b, maxT, maxC);
-		}
-	}
-#endif
 
-	
 	// computation in TF graph
 	void Compute(OpKernelContext* context) override 
 	{
@@ -195,48 +265,94 @@ public:
 			throw std::invalid_argument("the number of characters (chars) plus 1  must equal dimension 2 of the input tensor (mat)");
 		}
 
-		// input tensor
-		const auto inputMapped = inputTensor.tensor<float, 3>();
+		// input tensor, stored row-major
+		const float* inputData = inputTensor.flat<float>().data();
 
-		// output: BxT, int32
+		// output: BxT, int32, or BxNxT and three BxN float64 scores for the N-best ops
 		Tensor* outputTensor = nullptr;
-		OP_REQUIRES_OK(context, context->allocate_output(0, TensorShape({static_cast<int>(maxB), static_cast<int>(maxT)}), &outputTensor));
-		auto outputMapped = outputTensor->tensor<int32, 2>();
-
-#ifdef WBS_PARALLEL
-		// split work into number of threads
-		const size_t numThreads = WBS_THREADS;
-		const auto work = splitWork(numThreads, maxB);
-
-		// start threads
-		std::vector<std::thread> workers;
-		for(size_t th = 0; th < numThreads; ++th)
+		Tensor* opticalTensor = nullptr;
+		Tensor* textualTensor = nullptr;
+		Tensor* scoreTensor = nullptr;
+		if(m_numHypotheses == 0)
 		{
-			workers.push_back(std::thread( [&, th] { doWork(inputMapped, outputMapped, work, th, maxT, maxC); } ));
+			OP_REQUIRES_OK(context, context->allocate_output(0, TensorShape({static_cast<int>(maxB), static_cast<int>(maxT)}), &outputTensor));
+		}
+		else
+		{
+			const TensorShape scoreShape({static_cast<int>(maxB), static_cast<int>(m_numHypotheses)});
+			OP_REQUIRES_OK(context, context->allocate_output(0, TensorShape({static_cast<int>(maxB), static_cast<int>(m_numHypotheses), static_cast<int>(maxT)}), &outputTensor));
+			OP_REQUIRES_OK(context, context->allocate_output(1, scoreShape, &opticalTensor));
+			OP_REQUIRES_OK(context, context->allocate_output(2, scoreShape, &textualTensor));
+			OP_REQUIRES_OK(context, context->allocate_output(3, scoreShape, &scoreTensor));
 		}
 
-		// wait until all threads finished their work
-		for(auto& w : workers)
+		// number of time-steps to decode per batch element, given by the optional second input (WordBeamSearchSeqLen)
+		std::vector<size_t> numT(maxB, maxT);
+		if(context->num_inputs() > 1)
 		{
-			w.join();
+			const auto seqLenMapped = context->input(1).flat<int32>();
+			if(static_cast<size_t>(seqLenMapped.size()) != maxB)
+			{
+				throw std::invalid_argument("the number of sequence lengths (seqLen) must equal dimension 1 of the input tensor (mat)");
+			}
+			for(size_t b = 0; b < maxB; ++b)
+			{
+				if(seqLenMapped(b) < 0 || static_cast<size_t>(seqLenMapped(b)) > maxT)
+				{
+					throw std::invalid_argument("sequence lengths (seqLen) must be between 0 and dimension 0 of the input tensor (mat)");
+				}
+				numT[b] = static_cast<size_t>(seqLenMapped(b));
+			}
 		}
-#else
-		// go over all batch elements
-		for(size_t b = 0; b < maxB; ++b)
+
+		// decode batch elements in parallel: each thread takes the next batch element which is not decoded yet
+		std::vector<double> decodeTimes;
+		std::vector<DecodeStats> decodeStats(maxB);
+		m_threadPool->parallelFor(maxB, [&](size_t b)
 		{
-			// wrapper around Tensor
-			MatrixTensor<decltype(inputMapped)> mat(inputMapped, b, maxT, maxC);
+			// statistics are only collected if compiled with WBS_STATS
+			DecodeStats::Collect collect(&decodeStats[b]);
 
-			// apply decoding algorithm to batch element 
-			const std::vector<uint32_t> decoded = wordBeamSearch(mat, m_beamWidth, m_lm, m_lmType);
-			
-			// write to output tensor
-			fillResult(decoded, outputMapped, b, maxT, maxC);
+			// view of batch element
+			const auto mat = MatrixView<float>::fromBatch(inputData, b, numT[b], maxB, maxC);
+
+			// apply decoding algorithm to batch element and write to output tensors
+			if(m_numHypotheses == 0)
+			{
+				auto outputMapped = outputTensor->tensor<int32, 2>();
+				const std::vector<uint32_t> decoded = wordBeamSearch(mat, m_beamWidth, m_lm, m_lmType, m_logDomain, m_pruning);
+				fillResult(decoded, outputMapped, b, maxT, maxC);
+			}
+			else
+			{
+				auto outputMapped = outputTensor->tensor<int32, 3>();
+				auto opticalMapped = opticalTensor->matrix<double>();
+				auto textualMapped = textualTensor->matrix<double>();
+				auto scoreMapped = scoreTensor->matrix<double>();
+				const std::vector<Hypothesis> hyps = wordBeamSearchNBest(mat, m_beamWidth, m_numHypotheses, m_lm, m_lmType, m_logDomain, m_pruning);
+				fillHypotheses(hyps, outputMapped, opticalMapped, textualMapped, scoreMapped, b, maxT, maxC);
+			}
+		}, &decodeTimes);
+
+		// report running time and statistics per batch element
+		for(size_t b = 0; b < maxB; ++b)
+		{
+			VLOG(1) << "WordBeamSearch: decoded batch element " << b << " in " << decodeTimes[b] << "s";
+			if(DecodeStats::isEnabled())
+			{
+				const DecodeStats& stats = decodeStats[b];
+				VLOG(1) << "WordBeamSearch: batch element " << b << ": time-steps=" << stats.timeSteps << " blank frames=" << stats.blankFrames
+					<< " beams expanded=" << stats.beamsExpanded << " candidates=" << stats.candidates << " merges=" << stats.merges
+					<< " trie walks=" << stats.trieWalks << " next words calls=" << stats.nextWordsCalls << " next words enumerated=" << stats.nextWordsEnumerated
+					<< " LM lookups=" << stats.lmLookups << " expansion=" << stats.expansionTime << "s selection=" << stats.selectionTime << "s LM=" << stats.lmTime << "s";
+			}
 		}
-#endif
 	}
 };
 
 
 REGISTER_KERNEL_BUILDER(Name("WordBeamSearch").Device(DEVICE_CPU), TFWordBeamSearch);
+REGISTER_KERNEL_BUILDER(Name("WordBeamSearchSeqLen").Device(DEVICE_CPU), TFWordBeamSearch);
+REGISTER_KERNEL_BUILDER(Name("WordBeamSearchNBest").Device(DEVICE_CPU), TFWordBeamSearch);
+REGISTER_KERNEL_BUILDER(Name("WordBeamSearchNBestSeqLen").Device(DEVICE_CPU), TFWordBeamSearch);
 
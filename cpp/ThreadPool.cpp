@@ -0,0 +1,141 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <chrono>
+
+
+ThreadPool::ThreadPool(size_t numThreads)
+:m_nextItem(0)
+{
+	if (numThreads == 0)
+	{
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	// the calling thread also processes items, so one thread less is needed
+	for (size_t i = 1; i < numThreads; ++i)
+	{
+		m_workers.push_back(std::thread([this] { workerLoop(); }));
+	}
+}
+
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_jobStarted.notify_all();
+	for (auto& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)>& func, std::vector<double>* itemTimes)
+{
+	std::lock_guard<std::mutex> jobLock(m_jobMutex);
+	if (itemTimes)
+	{
+		itemTimes->assign(n, 0.0);
+	}
+
+	// no need to wake up the workers for a single item
+	if (m_workers.empty() || n <= 1)
+	{
+		m_nextItem = 0;
+		m_exception = nullptr;
+		processItems(func, n, itemTimes);
+		if (m_exception)
+		{
+			std::rethrow_exception(m_exception);
+		}
+		return;
+	}
+
+	// start job
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_func = &func;
+		m_numItems = n;
+		m_itemTimes = itemTimes;
+		m_nextItem = 0;
+		m_numWorkersDone = 0;
+		m_exception = nullptr;
+		++m_jobIdx;
+	}
+	m_jobStarted.notify_all();
+
+	// process items in calling thread, then wait until each worker has finished this job
+	processItems(func, n, itemTimes);
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_jobFinished.wait(lock, [this] { return m_numWorkersDone == m_workers.size(); });
+	m_func = nullptr;
+	m_itemTimes = nullptr;
+	if (m_exception)
+	{
+		std::rethrow_exception(m_exception);
+	}
+}
+
+
+void ThreadPool::workerLoop()
+{
+	uint64_t lastJobIdx = 0;
+	while (true)
+	{
+		// wait for next job
+		const std::function<void(size_t)>* func = nullptr;
+		size_t numItems = 0;
+		std::vector<double>* itemTimes = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobStarted.wait(lock, [&] { return m_stop || m_jobIdx != lastJobIdx; });
+			if (m_stop)
+			{
+				return;
+			}
+			lastJobIdx = m_jobIdx;
+			func = m_func;
+			numItems = m_numItems;
+			itemTimes = m_itemTimes;
+		}
+
+		processItems(*func, numItems, itemTimes);
+
+		// each worker takes part in each job, so no worker can take items from a later job
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_numWorkersDone;
+		}
+		m_jobFinished.notify_one();
+	}
+}
+
+
+void ThreadPool::processItems(const std::function<void(size_t)>& func, size_t numItems, std::vector<double>* itemTimes)
+{
+	for (size_t i = m_nextItem++; i < numItems; i = m_nextItem++)
+	{
+		try
+		{
+			const auto startTime = std::chrono::steady_clock::now();
+			func(i);
+			if (itemTimes)
+			{
+				(*itemTimes)[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+			}
+		}
+		catch (...)
+		{
+			// keep first exception and skip remaining items
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_exception)
+			{
+				m_exception = std::current_exception();
+			}
+			m_nextItem = numItems;
+		}
+	}
+}
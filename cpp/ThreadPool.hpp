@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <stdint.h>
+#include <cstddef>
+
+
+// persistent pool of threads which process the items 0, 1, ..., n-1 of a job in parallel.
+// Threads take the next unprocessed item from a shared counter, so items with a long running time do not delay the others
+class ThreadPool
+{
+public:
+	// CTOR: numThreads is the number of threads processing a job including the calling thread, 0 to use all cores
+	explicit ThreadPool(size_t numThreads);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t getNumThreads() const { return m_workers.size() + 1; }
+
+	// call func(i) for all items i in [0, n) and return when all items are processed. The first exception thrown by func is rethrown.
+	// If itemTimes is given, the running time of each item in seconds is written to it.
+	// Jobs passed from different threads are processed one after the other
+	void parallelFor(size_t n, const std::function<void(size_t)>& func, std::vector<double>* itemTimes = nullptr);
+
+private:
+	std::vector<std::thread> m_workers;
+	std::mutex m_jobMutex; // held while a job is processed
+
+	// current job, guarded by m_mutex (except the item counter)
+	std::mutex m_mutex;
+	std::condition_variable m_jobStarted;
+	std::condition_variable m_jobFinished;
+	const std::function<void(size_t)>* m_func = nullptr;
+	size_t m_numItems = 0;
+	std::vector<double>* m_itemTimes = nullptr;
+	std::atomic<size_t> m_nextItem;
+	uint64_t m_jobIdx = 0;
+	size_t m_numWorkersDone = 0;
+	std::exception_ptr m_exception;
+	bool m_stop = false;
+
+	void workerLoop();
+	void processItems(const std::function<void(size_t)>& func, size_t numItems, std::vector<double>* itemTimes);
+};
@@ -1,70 +1,74 @@
 #include "WordBeamSearch.hpp"
-#include "Beam.hpp"
+#include "StreamDecoder.hpp"
+#include "BeamArena.hpp"
 #include <vector>
 #include <memory>
 
 
-std::vector<uint32_t> wordBeamSearch(const IMatrix& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType)
+namespace
 {
-	// dim0: T, dim1: C
-	const size_t maxT = mat.rows();
-	const size_t maxC = mat.cols();
-	const size_t blank = maxC - 1;
+	// beams are recycled across time-steps and across calls from the same thread
+	BeamArena& getThreadArena()
+	{
+		static thread_local BeamArena arena;
+		return arena;
+	}
+}
 
-	// initialise with genesis beam
-	BeamList curr;
-	BeamList last;
-	const bool useNGrams = lmType == LanguageModelType::NGrams || lmType == LanguageModelType::NGramsForecast || lmType==LanguageModelType::NGramsForecastAndSample;
-	const bool forcastNGrams = lmType == LanguageModelType::NGramsForecast || lmType == LanguageModelType::NGramsForecastAndSample;
-	const bool sampleNGrams = lmType == LanguageModelType::NGramsForecastAndSample;
-	last.addBeam(std::make_shared<Beam>(lm, useNGrams, forcastNGrams, sampleNGrams));
 
-	// go over all time steps
-	for (size_t t = 0; t < maxT; ++t)
-	{
-		// get k best beams and iterate 
-		const std::vector<std::shared_ptr<Beam>> bestBeams = last.getBestBeams(beamWidth);
-		for (const auto& beam : bestBeams)
-		{
-			double prBlank=0.0, prNonBlank=0.0;
+template<class T>
+std::vector<uint32_t> wordBeamSearch(const MatrixView<T>& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, const CharPruning& pruning)
+{
+	return wordBeamSearch(mat, beamWidth, lm, lmType, logDomain, getThreadArena(), pruning);
+}
 
-			// calc prob that path ends with a non-blank
-			prNonBlank = beam->getText().empty() ? 0.0 : beam->getNonBlankProb() * mat.getAt(t, beam->getText().back());
 
-			// calc prob that path ends with a blank
-			prBlank = beam->getTotalProb() * mat.getAt(t, blank);
-			
-			// add copy of original beam to current time step
-			curr.addBeam(beam->createChildBeam(prBlank, prNonBlank));
+template<class T>
+std::vector<uint32_t> wordBeamSearch(const MatrixView<T>& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, BeamArena& arena, const CharPruning& pruning)
+{
+	// decode all time-steps as one chunk
+	StreamDecoder decoder(lm, lmType, beamWidth, logDomain, pruning, arena);
+	decoder.push(mat);
+	return decoder.finalize();
+}
 
-			// extend current beam
-			const std::vector<uint32_t> nextChars = beam->getNextChars();
-			for (const auto c : nextChars)
-			{
-				prBlank = 0.0;
-				prNonBlank = 0.0;
-				// last char in beam equals new char: path must end with blank
-				if (!beam->getText().empty() && beam->getText().back() == c)
-				{
-					prNonBlank = mat.getAt(t, c) * beam->getBlankProb();
-				}
-				// last char in beam and new char different
-				else
-				{
-					prNonBlank = mat.getAt(t, c) * beam->getTotalProb();
-				}
 
-				curr.addBeam(beam->createChildBeam(prBlank, prNonBlank, c));
-			}
-		}
 
-		last = std::move(curr);
-	}
+template<class T>
+std::vector<Hypothesis> wordBeamSearchNBest(const MatrixView<T>& mat, size_t beamWidth, size_t numHypotheses, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, const CharPruning& pruning)
+{
+	StreamDecoder decoder(lm, lmType, beamWidth, logDomain, pruning, getThreadArena());
+	decoder.push(mat);
+	return decoder.finalizeNBest(numHypotheses);
+}
+
+
+// the decoder is compiled for float and double matrices
+template std::vector<uint32_t> wordBeamSearch(const MatrixView<float>& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, const CharPruning& pruning);
+template std::vector<uint32_t> wordBeamSearch(const MatrixView<double>& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, const CharPruning& pruning);
+template std::vector<uint32_t> wordBeamSearch(const MatrixView<float>& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, BeamArena& arena, const CharPruning& pruning);
+template std::vector<uint32_t> wordBeamSearch(const MatrixView<double>& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, BeamArena& arena, const CharPruning& pruning);
+template std::vector<Hypothesis> wordBeamSearchNBest(const MatrixView<float>& mat, size_t beamWidth, size_t numHypotheses, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, const CharPruning& pruning);
+template std::vector<Hypothesis> wordBeamSearchNBest(const MatrixView<double>& mat, size_t beamWidth, size_t numHypotheses, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, const CharPruning& pruning);
 
-	// return best entry
-	const auto bestBeam = last.getBestBeams(1)[0];
-	bestBeam->completeText();
-	return bestBeam->getText();
+
+std::vector<uint32_t> wordBeamSearch(const IMatrix& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, const CharPruning& pruning)
+{
+	return wordBeamSearch(mat, beamWidth, lm, lmType, logDomain, getThreadArena(), pruning);
 }
 
 
+std::vector<uint32_t> wordBeamSearch(const IMatrix& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, BeamArena& arena, const CharPruning& pruning)
+{
+	// copy elements into a row-major buffer and decode a view of it
+	std::vector<double> buffer(mat.rows() * mat.cols());
+	for (size_t t = 0; t < mat.rows(); ++t)
+	{
+		for (size_t c = 0; c < mat.cols(); ++c)
+		{
+			buffer[t * mat.cols() + c] = mat.getAt(t, c);
+		}
+	}
+	const MatrixView<double> view(buffer.data(), mat.rows(), mat.cols(), static_cast<ptrdiff_t>(mat.cols()));
+	return wordBeamSearch(view, beamWidth, lm, lmType, logDomain, arena, pruning);
+}
@@ -1,10 +1,52 @@
 #pragma once
 #include "IMatrix.hpp"
+#include "MatrixView.hpp"
 #include "LanguageModel.hpp"
+#include "BeamArena.hpp"
+#include <vector>
 #include <stdint.h>
 #include <cstddef>
 
 
-// apply word beam search decoding on the matrix with given beam width
-std::vector<uint32_t> wordBeamSearch(const IMatrix& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType);
+// per time-step pruning of the chars which extend the beams, the blank is never pruned.
+// A char is skipped if its probability is below minProb or if it is not among the topN most probable chars (0 disables the respective criterion).
+// If the blank probability of a time-step is at least blankThreshold (0 disables it), no char extends the beams in this time-step
+struct CharPruning
+{
+	double minProb;
+	size_t topN;
+	double blankThreshold;
 
+	CharPruning(double minProb = 0.0, size_t topN = 0, double blankThreshold = 0.0) :minProb(minProb), topN(topN), blankThreshold(blankThreshold) {}
+	bool isActive() const { return minProb > 0.0 || topN > 0; } // true if chars are pruned by probability or rank
+};
+
+
+// decoded text with the scores of its beam, the scores are log-probabilities if decoded in log-domain
+struct Hypothesis
+{
+	std::vector<uint32_t> text;
+	double opticalScore = 0.0; // probability of all paths of the text given the matrix (Beam::getTotalProb)
+	double textualScore = 0.0; // LM score of the text (Beam::getTextualProb)
+	double score = 0.0; // opticalScore*textualScore, which ranks the hypotheses
+};
+
+
+// apply word beam search decoding on the matrix with given beam width, the matrix holds float or double values.
+// Scores are computed in log-domain if logDomain is set, which avoids underflow for long inputs
+template<class T>
+std::vector<uint32_t> wordBeamSearch(const MatrixView<T>& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain = false, const CharPruning& pruning = CharPruning());
+
+// same as above, but beams are allocated in the given arena instead of the arena of the calling thread
+template<class T>
+std::vector<uint32_t> wordBeamSearch(const MatrixView<T>& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, BeamArena& arena, const CharPruning& pruning = CharPruning());
+
+// same as above for a matrix given by the IMatrix interface, its elements are copied before decoding
+std::vector<uint32_t> wordBeamSearch(const IMatrix& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain = false, const CharPruning& pruning = CharPruning());
+std::vector<uint32_t> wordBeamSearch(const IMatrix& mat, size_t beamWidth, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain, BeamArena& arena, const CharPruning& pruning = CharPruning());
+
+
+// same as wordBeamSearch, but returns up to numHypotheses texts of the final beams, best first.
+// Texts which are equal after completing their last word are only returned once, with the scores of the best beam
+template<class T>
+std::vector<Hypothesis> wordBeamSearchNBest(const MatrixView<T>& mat, size_t beamWidth, size_t numHypotheses, const std::shared_ptr<LanguageModel>& lm, LanguageModelType lmType, bool logDomain = false, const CharPruning& pruning = CharPruning());
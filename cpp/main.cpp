@@ -32,7 +32,7 @@ int main()
 		const auto data = loader.getNext();
 
 		// decode it
-		const auto res = wordBeamSearch(data.mat, 10, lm, lmType);
+		const auto res = wordBeamSearch(data.mat.getView(), 10, lm, lmType);
 
 		// show results
 		std::cout << "Sample: " << ctr + 1 << "\n";
@@ -4,8 +4,22 @@
 #include "MatrixCSV.hpp"
 #include "Metrics.hpp"
 #include "WordBeamSearch.hpp"
+#include "DecodeStats.hpp"
 #include "DataLoader.hpp"
+#include "Beam.hpp"
+#include "BeamArena.hpp"
+#include "ThreadPool.hpp"
+#include "StreamDecoder.hpp"
 #include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
 #include <iostream>
 
 
@@ -27,6 +41,19 @@ void test()
 	assert(lm.getBigramProb(lm.utf8ToLabel("this"), lm.utf8ToLabel("and")) == 1.0 / 2.0);
 	assert(lm.getBigramProb(lm.utf8ToLabel("this"), lm.utf8ToLabel("that")) == 0.0);
 	assert(lm.getBigramProb(lm.utf8ToLabel("this"), lm.utf8ToLabel("yyy")) == 0.0);
+	assert(lm.getNumWords() == 6 && lm.getWordId(lm.utf8ToLabel("yyy")) == PrefixTree::invalidId);
+	assert(lm.getBigramProb(lm.getWordId(lm.utf8ToLabel("this")), lm.getWordId(lm.utf8ToLabel("is"))) == 1.0 / 2.0);
+	const auto lmNodeTh = lm.getChildNode(lm.getChildNode(lm.getRootNode(), lm.utf8ToLabel("t")[0]), lm.utf8ToLabel("h")[0]);
+	assert(std::abs(lm.getNextWordsUnigramProb(lmNodeTh) - 3.0 / 7.0) < 1e-12);
+	assert(std::abs(lm.getNextWordsUnigramProb(lm.getRootNode()) - 1.0) < 1e-12);
+	assert(lm.getNextWordsBigramProb(lm.getWordId(lm.utf8ToLabel("this")), lmNodeTh) == 0.0);
+	assert(std::abs(lm.getNextWordsBigramProb(lm.getWordId(lm.utf8ToLabel("this")), lm.getChildNode(lm.getRootNode(), lm.utf8ToLabel("a")[0])) - 1.0 / 2.0) < 1e-12);
+	LanguageModel lmAddK("this is a text. this and that.", "abcdefghijklmnopqrstuvwxyz., ", "abcdefghijklmnopqrstuvwxyz", LanguageModelType::NGrams, 1.0);
+	const auto lmAddKNodeT = lmAddK.getChildNode(lmAddK.getRootNode(), lmAddK.utf8ToLabel("t")[0]);
+	assert(std::abs(lmAddK.getNextWordsBigramProb(lmAddK.getWordId(lmAddK.utf8ToLabel("this")), lmAddKNodeT) - 3.0 / 8.0) < 1e-12);
+	assert(std::abs(lmAddK.getNextWordsBigramProb(lmAddK.getWordId(lmAddK.utf8ToLabel("this")), lmAddK.getRootNode()) - 1.0) < 1e-12);
+	assert(lmAddK.getBigramProb(lmAddK.utf8ToLabel("this"), lmAddK.utf8ToLabel("and")) == 2.0 / 8.0);
+	assert(lmAddK.getBigramProb(lmAddK.utf8ToLabel("this"), lmAddK.utf8ToLabel("that")) == 1.0 / 8.0);
 	
 
 	// test prefix tree, use language model to map between utf8 and label strings
@@ -39,6 +66,74 @@ void test()
 	assert(lm.labelToUtf8(t.getNextWords(lm.utf8ToLabel("that"))[0]) == "that");
 	assert(t.isWord(lm.utf8ToLabel("that")) == true);
 	assert(t.isWord(lm.utf8ToLabel("yyy")) == false);
+	assert(t.getNextWords(lm.utf8ToLabel("th")).size() == 2);
+	assert(t.getNextChars(lm.utf8ToLabel("thx")).empty());
+	const auto nodeTh = t.getChild(t.getChild(t.getRoot(), lm.utf8ToLabel("t")[0]), lm.utf8ToLabel("h")[0]);
+	assert(nodeTh == t.getNode(lm.utf8ToLabel("th")));
+	assert(t.isWord(t.getChild(t.getChild(nodeTh, lm.utf8ToLabel("a")[0]), lm.utf8ToLabel("t")[0])));
+	assert(t.getChild(nodeTh, lm.utf8ToLabel("x")[0]) == PrefixTree::invalidId);
+	assert(t.getNextWordIds(nodeTh) == std::make_pair(0u, 2u));
+	assert(lm.labelToUtf8(t.getWord(0)) == "that" && lm.labelToUtf8(t.getWord(1)) == "this");
+	assert(t.getWordId(t.getNode(lm.utf8ToLabel("this"))) == 1);
+
+
+	// store language model in binary file and load it again
+	lmAddK.save("test_lm.bin");
+	{
+		const auto lmLoaded = LanguageModel::load("test_lm.bin");
+		assert(lmLoaded->hasBigrams() && lmLoaded->getNumWords() == lmAddK.getNumWords());
+		assert(lmLoaded->getAllChars() == lmAddK.getAllChars() && lmLoaded->getWordChars() == lmAddK.getWordChars());
+		assert(lmLoaded->labelToUtf8(lmLoaded->utf8ToLabel("this, that.")) == "this, that.");
+		assert(lmLoaded->getUnigramProb(lmLoaded->utf8ToLabel("this")) == lmAddK.getUnigramProb(lmAddK.utf8ToLabel("this")));
+		assert(lmLoaded->getBigramProb(lmLoaded->utf8ToLabel("this"), lmLoaded->utf8ToLabel("and")) == 2.0 / 8.0);
+		assert(lmLoaded->getBigramProb(lmLoaded->utf8ToLabel("this"), lmLoaded->utf8ToLabel("that")) == 1.0 / 8.0);
+		std::vector<uint32_t> nextChars;
+		lmLoaded->getNextChars(lmLoaded->getChildNode(lmLoaded->getRootNode(), lmLoaded->utf8ToLabel("t")[0]), nextChars);
+		assert(lmLoaded->labelToUtf8(nextChars) == "eh");
+		assert(lmLoaded->getNextWords(lmLoaded->utf8ToLabel("tex")).size() == 1);
+
+		// saving a smaller LM to the same path replaces the file, the loaded LM still uses the old one
+		LanguageModel("a b.", "ab. ", "ab", LanguageModelType::Words).save("test_lm.bin");
+		assert(lmLoaded->getNumWords() == lmAddK.getNumWords());
+		assert(lmLoaded->getBigramProb(lmLoaded->utf8ToLabel("this"), lmLoaded->utf8ToLabel("and")) == 2.0 / 8.0);
+		assert(lmLoaded->getNextWords(lmLoaded->utf8ToLabel("tex")).size() == 1);
+		assert(LanguageModel::load("test_lm.bin")->getNumWords() == 2);
+		lmAddK.save("test_lm.bin");
+	}
+	{
+		// a successor id outside of the words is detected when loading: the file ends with the arrays of bigram successors, counts and
+		// probability sums (S elements each, uint32 arrays padded to 8 bytes), each preceded by its element count
+		std::ifstream inFile("test_lm.bin", std::ios::binary);
+		std::vector<char> bytes{ std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>() };
+		inFile.close();
+		size_t numSuccessors = 1;
+		for (; 8 * numSuccessors + 8 < bytes.size(); ++numSuccessors)
+		{
+			uint64_t size = 0;
+			std::memcpy(&size, bytes.data() + bytes.size() - 8 * numSuccessors - 8, sizeof(size));
+			if (size == numSuccessors)
+			{
+				break;
+			}
+		}
+		const size_t paddedSize = (4 * numSuccessors + 7) / 8 * 8;
+		const uint32_t invalidWord = 0xffff;
+		std::memcpy(bytes.data() + bytes.size() - 8 * numSuccessors - 8 - paddedSize - 8 - paddedSize, &invalidWord, sizeof(invalidWord));
+		std::ofstream outFile("test_lm.bin", std::ios::binary);
+		outFile.write(bytes.data(), bytes.size());
+		outFile.close();
+		bool thrown = false;
+		try
+		{
+			LanguageModel::load("test_lm.bin");
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown);
+	}
+	std::remove("test_lm.bin");
 
 
 	// test matrix class by reading from a csv file
@@ -47,6 +142,10 @@ void test()
 	assert(mat.cols() == 80);
 	assert(mat.getAt(0, 0) == 0.946499);
 	assert(mat.getAt(mat.rows()-1, mat.cols()-1) == 8.68117);
+	assert(mat.getView().getAt(mat.rows() - 1, mat.cols() - 1) == 8.68117);
+	const double tensor[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 }; // TxBxC = 2x3x2
+	const auto batchView = MatrixView<double>::fromBatch(tensor, 1, 2, 3, 2);
+	assert(batchView.rows() == 2 && batchView.cols() == 2 && batchView.getAt(0, 1) == 3 && batchView.getAt(1, 0) == 8);
 
 
 	// metrics (CER/WER)
@@ -62,11 +161,177 @@ void test()
 	assert(metrics.getWER() == 2.0/3.0);
 
 
+	// probabilities in log-domain
+	const ProbDomain logDomain(true);
+	assert(std::abs(logDomain.toProb(logDomain.add(logDomain.fromProb(0.25), logDomain.fromProb(0.5))) - 0.75) < 1e-12);
+	assert(logDomain.add(logDomain.zero(), logDomain.zero()) == logDomain.zero());
+	assert(logDomain.root(logDomain.fromProb(1e-300) * 4, 4) == logDomain.fromProb(1e-300));
+
+
+	// beams share the text of their parent beam
+	BeamArena arena;
+	const LanguageModel lmBeam("this is a text.", "abcdefghijklmnopqrstuvwxyz., ", "abcdefghijklmnopqrstuvwxyz", LanguageModelType::Words);
+	const auto label = [&](char c) {return lm.utf8ToLabel(std::string(1, c))[0]; };
+	{
+		BeamList beamList(arena);
+		Beam* genesis = arena.createBeam(lmBeam);
+		Beam* beamT = genesis->createChildBeam<LanguageModelType::Words>(0.0, 1.0, label('t'));
+		Beam* beamTh = beamT->createChildBeam<LanguageModelType::Words>(0.0, 1.0, label('h'));
+		Beam* beamTe = beamT->createChildBeam<LanguageModelType::Words>(0.0, 1.0, label('e'));
+		assert(genesis->getTextLength() == 0);
+		assert(lm.labelToUtf8(beamTh->getText()) == "th");
+		assert(lm.labelToUtf8(beamTe->getText()) == "te");
+		assert(beamTe->getTextLength() == 2 && beamTe->getLastChar() == label('e'));
+
+		// beams with equal text are merged, even if they do not share their text nodes
+		beamList.addBeam(beamTh);
+		beamList.addBeam(beamTe);
+		Beam* beamT2 = genesis->createChildBeam<LanguageModelType::Words>(0.0, 1.0, label('t'));
+		beamList.addBeam(beamT2->createChildBeam<LanguageModelType::Words>(0.0, 0.5, label('h')));
+		const auto& bestBeams = beamList.getBestBeams(10);
+		assert(bestBeams.size() == 2);
+		assert(bestBeams[0] == beamTh && beamTh->getTotalProb() == 1.5);
+		beamTh->completeText();
+		assert(lm.labelToUtf8(beamTh->getText()) == "this");
+		arena.releaseBeam(genesis);
+		arena.releaseBeam(beamT);
+		arena.releaseBeam(beamT2);
+	}
+
+	// all beams and nodes are reused after being released: repeating the same work allocates nothing new.
+	// A fresh arena has no spare objects in its free lists, so a single leaked object shows up as allocation
+	BeamArena reuseArena;
+	size_t numAllocations = 0;
+	for (size_t i = 0; i < 2; ++i)
+	{
+		numAllocations = reuseArena.getNumAllocations();
+		BeamList beamList(reuseArena);
+		Beam* genesis = reuseArena.createBeam(lmBeam);
+		Beam* beamA = genesis->createChildBeam<LanguageModelType::Words>(0.0, 1.0, label('a'));
+		beamList.addBeam(beamA->createChildBeam<LanguageModelType::Words>(0.0, 1.0, label('b')));
+		reuseArena.releaseBeam(genesis);
+		reuseArena.releaseBeam(beamA);
+	}
+	assert(reuseArena.getNumAllocations() == numAllocations && numAllocations > 0);
+
+
+	// thread pool processes each item once, exceptions are passed to the caller
+	ThreadPool pool(4);
+	assert(pool.getNumThreads() == 4);
+	for (size_t job = 0; job < 10; ++job)
+	{
+		std::vector<size_t> processed(100, 0);
+		pool.parallelFor(processed.size(), [&](size_t i) { processed[i]++; });
+		assert(std::count(processed.begin(), processed.end(), 1) == 100);
+	}
+	std::vector<double> itemTimes;
+	pool.parallelFor(8, [&](size_t i) { std::this_thread::sleep_for(std::chrono::milliseconds(i == 0 ? 10 : 1)); }, &itemTimes);
+	assert(itemTimes.size() == 8 && itemTimes[0] >= 0.01 && itemTimes[7] > 0.0);
+	bool thrown = false;
+	try
+	{
+		pool.parallelFor(100, [&](size_t i) { if (i == 50) throw std::runtime_error("error"); });
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+	assert(thrown);
+
+
 	// decode
 	DataLoader loader("../../data/test/", 1, LanguageModelType::NGrams);
 	const auto data=loader.getNext();
-	const auto decoded=wordBeamSearch(data.mat, 10, loader.getLanguageModel(), LanguageModelType::Words);
+	const auto decoded=wordBeamSearch(data.mat.getView(), 10, loader.getLanguageModel(), LanguageModelType::Words);
 	assert(loader.getLanguageModel()->labelToUtf8(decoded) == "ba");
+	assert(wordBeamSearch(data.mat, 10, loader.getLanguageModel(), LanguageModelType::Words) == decoded);
+	std::vector<float> matFloat;
+	for (size_t t = 0; t < data.mat.rows(); ++t)
+	{
+		for (size_t c = 0; c < data.mat.cols(); ++c)
+		{
+			matFloat.push_back(static_cast<float>(data.mat.getAt(t, c)));
+		}
+	}
+	assert(wordBeamSearch(MatrixView<float>(matFloat.data(), data.mat.rows(), data.mat.cols(), data.mat.cols()), 10, loader.getLanguageModel(), LanguageModelType::Words) == decoded);
+	// chars are only pruned if their probability is low enough: "b" is never the most probable char
+	assert(wordBeamSearch(data.mat.getView(), 10, loader.getLanguageModel(), LanguageModelType::Words, false, CharPruning(0.01)) == decoded);
+	assert(wordBeamSearch(data.mat.getView(), 10, loader.getLanguageModel(), LanguageModelType::Words, true, CharPruning(0.0, 2)) == decoded);
+	assert(loader.getLanguageModel()->labelToUtf8(wordBeamSearch(data.mat.getView(), 10, loader.getLanguageModel(), LanguageModelType::Words, false, CharPruning(0.0, 1))).find('b') == std::string::npos);
+	// no time-step has a blank probability of 0.5, but all time-steps have one of 0.1 and so no char is decoded
+	assert(wordBeamSearch(data.mat.getView(), 10, loader.getLanguageModel(), LanguageModelType::Words, false, CharPruning(0.0, 0, 0.5)) == decoded);
+	assert(wordBeamSearch(data.mat.getView(), 10, loader.getLanguageModel(), LanguageModelType::Words, false, CharPruning(0.0, 0, 0.1)).empty());
+	const auto decodedLog = wordBeamSearch(data.mat.getView(), 10, loader.getLanguageModel(), LanguageModelType::NGrams, true);
+	assert(loader.getLanguageModel()->labelToUtf8(decodedLog) == "ba");
+	loader.getLanguageModel()->save("test_lm.bin");
+	const auto decodedLoaded = wordBeamSearch(data.mat.getView(), 10, LanguageModel::load("test_lm.bin"), LanguageModelType::NGrams);
+	assert(decodedLoaded == decodedLog);
+	std::remove("test_lm.bin");
+
+	// statistics are only collected if compiled with WBS_STATS
+	DecodeStats stats;
+	{
+		DecodeStats::Collect collect(&stats);
+		wordBeamSearch(data.mat.getView(), 10, loader.getLanguageModel(), LanguageModelType::NGramsForecast);
+	}
+	if (DecodeStats::isEnabled())
+	{
+		assert(stats.timeSteps == data.mat.rows() && stats.beamsExpanded > 0 && stats.candidates >= stats.beamsExpanded && stats.lmLookups > 0 && stats.nextWordsCalls > 0);
+	}
+	else
+	{
+		assert(stats.timeSteps == 0 && stats.candidates == 0 && stats.expansionTime == 0.0);
+	}
+	assert(DecodeStats::current() == nullptr);
+
+	// decoding again with the same arena does not allocate memory for beams
+	BeamArena decodeArena;
+	wordBeamSearch(data.mat.getView(), 10, loader.getLanguageModel(), LanguageModelType::NGrams, false, decodeArena);
+	const size_t numDecodeAllocations = decodeArena.getNumAllocations();
+	wordBeamSearch(data.mat.getView(), 10, loader.getLanguageModel(), LanguageModelType::NGrams, false, decodeArena);
+	assert(decodeArena.getNumAllocations() == numDecodeAllocations);
+
+	// decoding the input in chunks gives the same result as decoding it at once, the decoder can be reused after finalize()
+	StreamDecoder stream(loader.getLanguageModel(), LanguageModelType::NGrams, 10);
+	const auto decodedNGrams = wordBeamSearch(data.mat.getView(), 10, loader.getLanguageModel(), LanguageModelType::NGrams);
+	for (size_t chunkSize : { size_t(1), size_t(2), data.mat.rows() })
+	{
+		for (size_t t = 0; t < data.mat.rows(); t += chunkSize)
+		{
+			const size_t numT = std::min(chunkSize, data.mat.rows() - t);
+			stream.push(MatrixView<double>(data.mat.getView().row(t), numT, data.mat.cols(), data.mat.cols()));
+			assert(stream.getNumFrames() == t + numT);
+			stream.partial();
+		}
+		assert(stream.finalize() == decodedNGrams);
+		assert(stream.getNumFrames() == 0);
+	}
+	stream.push(data.mat.getView());
+	thrown = false;
+	try
+	{
+		stream.push(MatrixView<double>(data.mat.getView().row(0), 1, data.mat.cols() - 1, data.mat.cols()));
+	}
+	catch (const std::invalid_argument&)
+	{
+		thrown = true;
+	}
+	assert(thrown);
+	stream.reset();
+	assert(stream.partial().empty());
+
+	// N-best list: the best hypothesis is the decoded text, hypotheses are ranked by their score and their texts differ
+	const auto hyps = wordBeamSearchNBest(data.mat.getView(), 10, 5, loader.getLanguageModel(), LanguageModelType::NGrams);
+	assert(hyps.size() > 1 && hyps.size() <= 5);
+	assert(hyps[0].text == decodedNGrams);
+	for (size_t i = 0; i < hyps.size(); ++i)
+	{
+		assert(std::abs(hyps[i].score - hyps[i].opticalScore * hyps[i].textualScore) < 1e-12);
+		assert(i == 0 || (hyps[i].score <= hyps[i - 1].score && hyps[i].text != hyps[i - 1].text));
+	}
+	const auto hypsLog = wordBeamSearchNBest(data.mat.getView(), 10, 5, loader.getLanguageModel(), LanguageModelType::NGrams, true);
+	assert(hypsLog.size() == hyps.size() && hypsLog[0].text == decodedNGrams && std::abs(std::exp(hypsLog[0].score) - hyps[0].score) < 1e-9);
+	assert(wordBeamSearchNBest(data.mat.getView(), 10, 1, loader.getLanguageModel(), LanguageModelType::NGrams).size() == 1);
 
 	
 	std::cout << "UNITTESTS: end\n";
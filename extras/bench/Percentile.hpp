@@ -0,0 +1,17 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+
+// percentile (nearest-rank) of sorted values, 0 if there are no values.
+// Shared by the benchmarks and the statistics of the decode server, so they report the same quantity
+inline double getPercentile(const std::vector<double>& sortedValues, double percentile)
+{
+	if (sortedValues.empty())
+	{
+		return 0.0;
+	}
+	const size_t rank = static_cast<size_t>(percentile / 100.0 * sortedValues.size() + 0.999999);
+	return sortedValues[std::min(std::max(rank, size_t(1)), sortedValues.size()) - 1];
+}
@@ -0,0 +1,74 @@
+#include "../../cpp/Beam.hpp"
+#include "../../cpp/BeamArena.hpp"
+#include "../../cpp/LanguageModel.hpp"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+
+// per-time-step cost of BeamList (create and add candidates, select best beams) for an increasing number of candidates
+int main()
+{
+	const size_t beamWidth = 25;
+	const size_t numRepetitions = 200;
+	const std::string chars = "abcdefghijklmnopqrstuvwxyz ";
+	const LanguageModel lm("a b c", chars, "abcdefghijklmnopqrstuvwxyz", LanguageModelType::Words);
+	const uint32_t numLabels = static_cast<uint32_t>(chars.size());
+	BeamArena arena;
+
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<double> distPr(0.0, 1.0);
+	std::uniform_int_distribution<uint32_t> distLabel(0, numLabels - 1);
+
+	// parent beams with some text, as they occur in the middle of a text-line
+	BeamList parents(arena);
+	for (size_t i = 0; i < beamWidth; ++i)
+	{
+		Beam* beam = arena.createBeam(lm);
+		for (size_t j = 0; j < 50; ++j)
+		{
+			Beam* child = beam->createChildBeam<LanguageModelType::Words>(0.0, 1.0, distLabel(rng));
+			arena.releaseBeam(beam);
+			beam = child;
+		}
+		parents.addBeam(beam);
+	}
+	const std::vector<Beam*> parentBeams = parents.getBestBeams(beamWidth);
+
+	std::cout << "candidates;us per time-step\n";
+	for (size_t numCandidates = beamWidth; numCandidates <= 6400; numCandidates *= 2)
+	{
+		// candidates: each parent beam extended by random labels (duplicates get merged)
+		std::vector<std::pair<uint32_t, double>> candidates;
+		for (size_t i = 0; i < numCandidates; ++i)
+		{
+			candidates.push_back(std::make_pair(distLabel(rng), distPr(rng)));
+		}
+
+		const auto startTime = std::chrono::steady_clock::now();
+		size_t numSelected = 0;
+		BeamList beamList(arena);
+		for (size_t r = 0; r < numRepetitions; ++r)
+		{
+			for (size_t i = 0; i < numCandidates; ++i)
+			{
+				beamList.addBeam(parentBeams[i % beamWidth]->createChildBeam<LanguageModelType::Words>(0.0, candidates[i].second, candidates[i].first));
+			}
+			numSelected += beamList.getBestBeams(beamWidth).size();
+			beamList.clear();
+		}
+		const auto duration = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+
+		std::cout << numCandidates << ";" << std::fixed << std::setprecision(2) << duration / numRepetitions << "\n";
+		if (numSelected == 0)
+		{
+			std::cout << "no beams selected\n";
+		}
+	}
+
+	return 0;
+}
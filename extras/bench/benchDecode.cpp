@@ -0,0 +1,135 @@
+#include "../../cpp/DataLoader.hpp"
+#include "../../cpp/WordBeamSearch.hpp"
+#include "Percentile.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstddef>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+
+namespace
+{
+	// peak resident set size of the process in KB, -1 if not available
+	long getPeakRssKb()
+	{
+#ifdef _WIN32
+		return -1;
+#else
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+		{
+			return -1;
+		}
+#ifdef __APPLE__
+		return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+		return usage.ru_maxrss;
+#endif
+#endif
+	}
+
+
+	double elapsedMs(std::chrono::steady_clock::time_point startTime)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	}
+}
+
+
+// decode the sample sets for each LM type and beam width, with warm-up and repeated runs.
+// Writes one CSV line per configuration to stdout, and additionally to the file given as first argument
+int main(int argc, char* argv[])
+{
+	const std::vector<std::string> datasets = { "bentham", "iam" };
+	const std::vector<std::pair<LanguageModelType, std::string>> lmTypes = {
+		{ LanguageModelType::Words, "Words" },
+		{ LanguageModelType::NGrams, "NGrams" },
+		{ LanguageModelType::NGramsForecast, "NGramsForecast" },
+		{ LanguageModelType::NGramsForecastAndSample, "NGramsForecastAndSample" } };
+	const std::vector<size_t> beamWidths = { 10, 25, 50 };
+	const size_t numWarmUpRuns = 1;
+	const size_t numRuns = 10;
+	const double addK = 0.01;
+	const unsigned int randomSeed = 42; // NGramsForecastAndSample samples words with std::rand
+
+	std::ostringstream csv;
+	csv << "dataset;lm type;beam width;samples;runs;lm build ms;p50 ms;p90 ms;p99 ms;max ms;samples per s;peak rss kb\n";
+	std::cout << csv.str() << std::flush;
+
+	for (const auto& dataset : datasets)
+	{
+		for (const auto& lmType : lmTypes)
+		{
+			// the LM is created while loading the dataset
+			const auto lmStartTime = std::chrono::steady_clock::now();
+			DataLoader loader{ "../../data/" + dataset + "/", 1, lmType.first, addK };
+			const double lmBuildMs = elapsedMs(lmStartTime);
+			const auto lm = loader.getLanguageModel();
+			std::vector<DataLoader::Data> samples;
+			while (loader.hasNext())
+			{
+				samples.push_back(loader.getNext());
+			}
+
+			for (const auto beamWidth : beamWidths)
+			{
+				// each configuration sees the same random numbers, independent of the configurations decoded before
+				std::srand(randomSeed);
+
+				// warm-up runs fill caches and the beam arena of this thread, they are not measured
+				for (size_t r = 0; r < numWarmUpRuns; ++r)
+				{
+					for (const auto& sample : samples)
+					{
+						wordBeamSearch(sample.mat.getView(), beamWidth, lm, lmType.first);
+					}
+				}
+
+				// latency of each sample in each run
+				std::vector<double> latencies;
+				const auto startTime = std::chrono::steady_clock::now();
+				for (size_t r = 0; r < numRuns; ++r)
+				{
+					for (const auto& sample : samples)
+					{
+						const auto sampleStartTime = std::chrono::steady_clock::now();
+						wordBeamSearch(sample.mat.getView(), beamWidth, lm, lmType.first);
+						latencies.push_back(elapsedMs(sampleStartTime));
+					}
+				}
+				const double totalMs = elapsedMs(startTime);
+				std::sort(latencies.begin(), latencies.end());
+
+				std::ostringstream line;
+				line << dataset << ";" << lmType.second << ";" << beamWidth << ";" << samples.size() << ";" << numRuns << ";";
+				line << std::fixed << std::setprecision(3) << lmBuildMs << ";";
+				line << getPercentile(latencies, 50) << ";" << getPercentile(latencies, 90) << ";" << getPercentile(latencies, 99) << ";" << latencies.back() << ";";
+				line << std::setprecision(1) << latencies.size() / (totalMs / 1000.0) << ";" << getPeakRssKb() << "\n";
+				csv << line.str();
+				std::cout << line.str() << std::flush;
+			}
+		}
+	}
+
+	if (argc > 1)
+	{
+		std::ofstream file(argv[1]);
+		file << csv.str();
+		if (!file)
+		{
+			std::cerr << "can not write file " << argv[1] << "\n";
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,56 @@
+#include "../../cpp/DataLoader.hpp"
+#include "../../cpp/WordBeamSearch.hpp"
+#include "../../cpp/Metrics.hpp"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+
+// speed/accuracy trade-off of the char pruning and the blank frames: decoding time and CER/WER of the samples of each dataset for several pruning settings
+int main()
+{
+	const size_t beamWidth = 25;
+	const size_t numRepetitions = 5;
+	const LanguageModelType lmType = LanguageModelType::NGrams;
+	const std::vector<std::string> datasets = { "bentham", "iam" };
+	const std::vector<CharPruning> settings = { CharPruning(), CharPruning(1e-4), CharPruning(1e-3), CharPruning(1e-2), CharPruning(0.0, 10), CharPruning(0.0, 5), CharPruning(0.0, 3), CharPruning(1e-3, 5), CharPruning(0.0, 0, 0.999), CharPruning(0.0, 0, 0.99), CharPruning(1e-3, 0, 0.999) };
+
+	std::cout << "dataset;min prob;top n;blank threshold;ms per sample;CER;WER\n";
+	for (const auto& dataset : datasets)
+	{
+		// load all samples once
+		DataLoader loader{ "../../data/" + dataset + "/", 1, lmType, 0.01 };
+		const auto lm = loader.getLanguageModel();
+		std::vector<DataLoader::Data> samples;
+		while (loader.hasNext())
+		{
+			samples.push_back(loader.getNext());
+		}
+
+		for (const auto& pruning : settings)
+		{
+			Metrics metrics{ lm->getWordChars() };
+			const auto startTime = std::chrono::steady_clock::now();
+			for (size_t r = 0; r < numRepetitions; ++r)
+			{
+				for (const auto& sample : samples)
+				{
+					const auto res = wordBeamSearch(sample.mat.getView(), beamWidth, lm, lmType, false, pruning);
+					if (r == 0)
+					{
+						metrics.addResult(sample.gt, res);
+					}
+				}
+			}
+			const auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+			std::cout << dataset << ";" << pruning.minProb << ";" << pruning.topN << ";" << pruning.blankThreshold << ";" << std::fixed << std::setprecision(2) << duration / (numRepetitions * samples.size()) << ";";
+			std::cout << std::setprecision(4) << metrics.getCER() << ";" << metrics.getWER() << "\n" << std::defaultfloat;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,10 @@
+#!/bin/bash
+
+
+# build the benchmarks, the executables are written to the current directory
+CPP=../../cpp
+CORE="$CPP/WordBeamSearch.cpp $CPP/PrefixTree.cpp $CPP/BinaryFile.cpp $CPP/LanguageModel.cpp $CPP/Beam.cpp $CPP/BeamArena.cpp $CPP/StreamDecoder.cpp"
+
+g++ -Wall -O2 -DNDEBUG --std=c++11 -o benchBeamList benchBeamList.cpp $CORE -lpthread
+g++ -Wall -O2 -DNDEBUG --std=c++11 -o benchPruning benchPruning.cpp $CORE $CPP/DataLoader.cpp $CPP/MatrixCSV.cpp $CPP/Metrics.cpp -lpthread
+g++ -Wall -O2 -DNDEBUG --std=c++11 -o benchDecode benchDecode.cpp $CORE $CPP/DataLoader.cpp $CPP/MatrixCSV.cpp $CPP/Metrics.cpp -lpthread
@@ -0,0 +1,84 @@
+#include "DecodeClient.hpp"
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+
+
+DecodeClient::DecodeClient(const std::string& address)
+:m_fd(connectTo(address))
+{
+}
+
+
+DecodeClient::~DecodeClient()
+{
+	::close(m_fd);
+}
+
+
+void DecodeClient::send(const DecodeRequest& request)
+{
+	sendMessage(m_fd, MessageType::DecodeRequest, serialize(request));
+}
+
+
+DecodeResponse DecodeClient::receive()
+{
+	MessageType type;
+	std::vector<char> payload;
+	if (!receiveMessage(m_fd, type, payload))
+	{
+		throw std::runtime_error("server closed the connection");
+	}
+	if (type != MessageType::DecodeResponse)
+	{
+		throw std::runtime_error("unexpected message type, expected a decode response");
+	}
+	DecodeResponse response;
+	parse(payload, response);
+	return response;
+}
+
+
+DecodeResponse DecodeClient::decode(const DecodeRequest& request)
+{
+	send(request);
+	return receive();
+}
+
+
+ServerStats DecodeClient::getStats()
+{
+	sendMessage(m_fd, MessageType::StatsRequest, std::vector<char>());
+	MessageType type;
+	std::vector<char> payload;
+	if (!receiveMessage(m_fd, type, payload))
+	{
+		throw std::runtime_error("server closed the connection");
+	}
+	if (type != MessageType::StatsResponse)
+	{
+		throw std::runtime_error("unexpected message type, expected statistics");
+	}
+	ServerStats stats;
+	parse(payload, stats);
+	return stats;
+}
+
+
+DecodeRequest DecodeClient::createRequest(uint64_t id, const MatrixView<double>& mat)
+{
+	DecodeRequest request;
+	request.id = id;
+	request.numT = static_cast<uint32_t>(mat.rows());
+	request.numC = static_cast<uint32_t>(mat.cols());
+	request.mat.reserve(mat.rows() * mat.cols());
+	for (size_t t = 0; t < mat.rows(); ++t)
+	{
+		for (size_t c = 0; c < mat.cols(); ++c)
+		{
+			request.mat.push_back(static_cast<float>(mat.getAt(t, c)));
+		}
+	}
+	return request;
+}
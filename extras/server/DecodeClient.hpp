@@ -0,0 +1,33 @@
+#pragma once
+#include "Protocol.hpp"
+#include "../../cpp/MatrixView.hpp"
+#include <string>
+#include <stdint.h>
+#include <cstddef>
+
+
+// connection to the decode server. Requests can be pipelined: send several requests, then receive their responses in the order in which they are decoded
+class DecodeClient
+{
+public:
+	// CTOR: connect to server, address as given to the server
+	explicit DecodeClient(const std::string& address);
+	~DecodeClient();
+	DecodeClient(const DecodeClient&) = delete;
+	DecodeClient& operator=(const DecodeClient&) = delete;
+
+	void send(const DecodeRequest& request);
+	DecodeResponse receive();
+
+	// send request and wait for its response, no other requests may be pending
+	DecodeResponse decode(const DecodeRequest& request);
+
+	// statistics of the server, no requests may be pending
+	ServerStats getStats();
+
+	// copy matrix (TxC, softmax applied) into a request with default parameters
+	static DecodeRequest createRequest(uint64_t id, const MatrixView<double>& mat);
+
+private:
+	int m_fd = -1;
+};
@@ -0,0 +1,345 @@
+#include "DecodeServer.hpp"
+#include "../../cpp/WordBeamSearch.hpp"
+#include "../../cpp/MatrixView.hpp"
+#include "../bench/Percentile.hpp"
+#include <algorithm>
+#include <iterator>
+#include <iostream>
+#include <stdexcept>
+#include <exception>
+#include <string>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+
+namespace
+{
+	// number of recent requests whose latencies are used for the percentiles
+	const size_t numLatencies = 4096;
+
+
+	double getElapsedMs(std::chrono::steady_clock::time_point startTime, std::chrono::steady_clock::time_point endTime)
+	{
+		return std::chrono::duration<double, std::milli>(endTime - startTime).count();
+	}
+}
+
+
+DecodeServer::Connection::~Connection()
+{
+	::close(fd);
+}
+
+
+DecodeServer::DecodeServer(const std::vector<std::shared_ptr<LanguageModel>>& lms, const Config& config)
+:m_lms(lms)
+,m_config(config)
+,m_threadPool(config.numThreads)
+{
+	if (m_lms.empty())
+	{
+		throw std::invalid_argument("the server needs at least one LM");
+	}
+	m_config.maxBatchSize = std::max(m_config.maxBatchSize, size_t(1));
+	m_batchThread = std::thread(&DecodeServer::batchRequests, this);
+}
+
+
+DecodeServer::~DecodeServer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		m_stop = true;
+	}
+	m_queueChanged.notify_all();
+	m_batchThread.join();
+	joinFinishedConnections(true);
+}
+
+
+void DecodeServer::run(int listenFd, const volatile std::sig_atomic_t& stopRequested)
+{
+	while (!stopRequested)
+	{
+		// wake up regularly to check if the server should stop and to clean up closed connections
+		pollfd pfd;
+		pfd.fd = listenFd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		const int numReady = ::poll(&pfd, 1, 100);
+		joinFinishedConnections(false);
+		if (numReady <= 0)
+		{
+			continue;
+		}
+
+		const int fd = ::accept(listenFd, nullptr, nullptr);
+		if (fd < 0)
+		{
+			continue;
+		}
+		const int noDelay = 1;
+		::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)); // fails for Unix domain sockets, which is fine
+
+		// a client which does not read its responses must not block the threads sending them
+		timeval sendTimeout;
+		sendTimeout.tv_sec = static_cast<time_t>(m_config.sendTimeoutMs / 1000.0);
+		sendTimeout.tv_usec = static_cast<suseconds_t>((m_config.sendTimeoutMs - 1000.0 * sendTimeout.tv_sec) * 1000.0);
+		::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+
+		auto connection = std::make_shared<Connection>(fd);
+		connection->reader = std::thread(&DecodeServer::readRequests, this, connection);
+		m_connections.push_back(connection);
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		m_stats.numConnections = m_connections.size();
+	}
+
+	// unblock the reading threads, but keep the sockets open for sending: the queued requests are answered when the server is destroyed,
+	// and the sockets are closed when the last queued request of a connection is done
+	for (const auto& connection : m_connections)
+	{
+		::shutdown(connection->fd, SHUT_RD);
+	}
+	joinFinishedConnections(true);
+}
+
+
+ServerStats DecodeServer::getStats() const
+{
+	ServerStats res;
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		res = m_stats;
+		std::vector<double> latencies = m_latencies;
+		std::sort(latencies.begin(), latencies.end());
+		res.p50LatencyMs = getPercentile(latencies, 50);
+		res.p90LatencyMs = getPercentile(latencies, 90);
+		res.p99LatencyMs = getPercentile(latencies, 99);
+		res.maxLatencyMs = latencies.empty() ? 0.0 : latencies.back();
+		res.meanBatchSize = m_stats.numBatches > 0 ? double(m_numBatchedRequests) / m_stats.numBatches : 0.0;
+		double sumQueueTimes = 0.0;
+		for (const auto queueTime : m_queueTimes)
+		{
+			sumQueueTimes += queueTime;
+		}
+		res.meanQueueMs = m_queueTimes.empty() ? 0.0 : sumQueueTimes / m_queueTimes.size();
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		res.queueDepth = m_queue.size();
+	}
+	return res;
+}
+
+
+void DecodeServer::readRequests(const std::shared_ptr<Connection>& connection)
+{
+	try
+	{
+		MessageType type;
+		std::vector<char> payload;
+		while (receiveMessage(connection->fd, type, payload))
+		{
+			if (type == MessageType::StatsRequest)
+			{
+				const auto stats = getStats();
+				std::lock_guard<std::mutex> lock(connection->sendMutex);
+				sendMessage(connection->fd, MessageType::StatsResponse, serialize(stats));
+				continue;
+			}
+			if (type != MessageType::DecodeRequest)
+			{
+				throw std::runtime_error("unexpected message type " + std::to_string(static_cast<uint32_t>(type)));
+			}
+
+			QueuedRequest queued;
+			parse(payload, queued.request);
+			queued.connection = connection;
+			queued.receiveTime = Clock::now();
+
+			// reject request if the queue is full, so the latency of the queued requests does not grow further
+			std::unique_lock<std::mutex> lock(m_queueMutex);
+			if (m_queue.size() >= m_config.maxQueueSize)
+			{
+				lock.unlock();
+				DecodeResponse response;
+				response.id = queued.request.id;
+				response.error = "queue is full";
+				sendResponse(*connection, response);
+				addLatency(getElapsedMs(queued.receiveTime, Clock::now()), 0.0, true);
+				continue;
+			}
+			m_queue.push_back(std::move(queued));
+			const size_t queueDepth = m_queue.size();
+			lock.unlock();
+			m_queueChanged.notify_one();
+
+			std::lock_guard<std::mutex> statsLock(m_statsMutex);
+			m_stats.maxQueueDepth = std::max<uint64_t>(m_stats.maxQueueDepth, queueDepth);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		// the connection is dropped, the other connections are not affected
+		std::cerr << "connection closed: " << e.what() << "\n";
+		::shutdown(connection->fd, SHUT_RDWR);
+	}
+	connection->done = true;
+}
+
+
+void DecodeServer::batchRequests()
+{
+	std::vector<QueuedRequest> batch;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_queueMutex);
+			m_queueChanged.wait(lock, [&] { return m_stop || !m_queue.empty(); });
+
+			// when stopping, the queued requests are decoded without waiting, so each client gets a response for each accepted request
+			if (m_queue.empty())
+			{
+				return;
+			}
+
+			// wait for further requests until the batch is full or the oldest request has waited long enough.
+			// Requests arriving while a batch is decoded are queued, so under load the batches fill up without waiting
+			const auto deadline = m_queue.front().receiveTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(m_config.maxWaitMs));
+			m_queueChanged.wait_until(lock, deadline, [&] { return m_stop || m_queue.size() >= m_config.maxBatchSize; });
+
+			const size_t batchSize = std::min(m_queue.size(), m_config.maxBatchSize);
+			batch.clear();
+			std::move(m_queue.begin(), m_queue.begin() + batchSize, std::back_inserter(batch));
+			m_queue.erase(m_queue.begin(), m_queue.begin() + batchSize);
+		}
+
+		decodeBatch(batch);
+		batch.clear(); // releases the connections
+	}
+}
+
+
+void DecodeServer::decodeBatch(std::vector<QueuedRequest>& batch)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		++m_stats.numBatches;
+		m_numBatchedRequests += batch.size();
+	}
+
+	// each thread of the pool takes the next request, the response is sent as soon as the request is decoded
+	m_threadPool.parallelFor(batch.size(), [&](size_t i)
+	{
+		const QueuedRequest& queued = batch[i];
+		const auto startTime = Clock::now();
+		DecodeResponse response = decode(queued.request);
+		const auto endTime = Clock::now();
+		response.queueMs = getElapsedMs(queued.receiveTime, startTime);
+		response.decodeMs = getElapsedMs(startTime, endTime);
+		sendResponse(*queued.connection, response);
+		addLatency(getElapsedMs(queued.receiveTime, Clock::now()), response.queueMs, !response.error.empty());
+	});
+}
+
+
+DecodeResponse DecodeServer::decode(const DecodeRequest& request) const
+{
+	DecodeResponse response;
+	response.id = request.id;
+	try
+	{
+		if (request.lmIdx >= m_lms.size())
+		{
+			throw std::invalid_argument("unknown LM index " + std::to_string(request.lmIdx));
+		}
+		if (request.lmType > static_cast<uint32_t>(LanguageModelType::NGramsForecastAndSample))
+		{
+			throw std::invalid_argument("unknown LM type " + std::to_string(request.lmType));
+		}
+		const auto& lm = m_lms[request.lmIdx];
+		const auto lmType = static_cast<LanguageModelType>(request.lmType);
+		if (lmType != LanguageModelType::Words && !lm->hasBigrams())
+		{
+			throw std::invalid_argument("LM " + std::to_string(request.lmIdx) + " was created for LM type Words and can not be used for N-grams");
+		}
+		if (request.numC != lm->getAllChars().size() + 1)
+		{
+			throw std::invalid_argument("the number of characters of the LM plus 1 must equal the number of columns of the matrix");
+		}
+		if (request.beamWidth == 0)
+		{
+			throw std::invalid_argument("beam width must be at least 1");
+		}
+
+		const MatrixView<float> mat(request.mat.data(), request.numT, request.numC, static_cast<ptrdiff_t>(request.numC));
+		const CharPruning pruning(request.pruneMinProb, request.pruneTopN, request.blankThreshold);
+		response.text = wordBeamSearch(mat, request.beamWidth, lm, lmType, request.logDomain != 0, pruning);
+	}
+	catch (const std::exception& e)
+	{
+		response.error = e.what();
+	}
+	return response;
+}
+
+
+void DecodeServer::sendResponse(Connection& connection, const DecodeResponse& response)
+{
+	try
+	{
+		std::lock_guard<std::mutex> lock(connection.sendMutex);
+		sendMessage(connection.fd, MessageType::DecodeResponse, serialize(response));
+	}
+	catch (const std::exception&)
+	{
+		// client closed the connection or did not read its responses within the send timeout: drop the connection
+		::shutdown(connection.fd, SHUT_RDWR);
+	}
+}
+
+
+void DecodeServer::addLatency(double latencyMs, double queueMs, bool isError)
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	++m_stats.numRequests;
+	if (isError)
+	{
+		++m_stats.numErrors;
+	}
+
+	if (m_latencies.size() < numLatencies)
+	{
+		m_latencies.push_back(latencyMs);
+		m_queueTimes.push_back(queueMs);
+	}
+	else
+	{
+		m_latencies[m_nextLatencyIdx] = latencyMs;
+		m_queueTimes[m_nextLatencyIdx] = queueMs;
+	}
+	m_nextLatencyIdx = (m_nextLatencyIdx + 1) % numLatencies;
+}
+
+
+void DecodeServer::joinFinishedConnections(bool all)
+{
+	for (auto it = m_connections.begin(); it != m_connections.end();)
+	{
+		if (all || (*it)->done)
+		{
+			(*it)->reader.join();
+			it = m_connections.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_stats.numConnections = m_connections.size();
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "Protocol.hpp"
+#include "../../cpp/LanguageModel.hpp"
+#include "../../cpp/ThreadPool.hpp"
+#include <vector>
+#include <deque>
+#include <list>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <stdint.h>
+#include <cstddef>
+
+
+// server which decodes the requests of its clients with the LMs loaded at start-up.
+// Each connection has a thread which reads its requests into a shared queue. The requests received until the oldest one has waited maxWaitMs
+// (or until maxBatchSize requests are queued) are decoded as one batch on the thread pool, and each response is sent as soon as it is decoded
+class DecodeServer
+{
+public:
+	struct Config
+	{
+		size_t numThreads = 0; // threads decoding a batch, 0 to use all cores
+		size_t maxBatchSize = 32;
+		double maxWaitMs = 2.0; // time a request waits for other requests to be batched with
+		size_t maxQueueSize = 4096; // requests exceeding this are answered with an error
+		double sendTimeoutMs = 1000.0; // a connection whose client does not read its responses for this time is dropped, 0 for no timeout
+	};
+
+	// CTOR
+	DecodeServer(const std::vector<std::shared_ptr<LanguageModel>>& lms, const Config& config);
+	~DecodeServer();
+	DecodeServer(const DecodeServer&) = delete;
+	DecodeServer& operator=(const DecodeServer&) = delete;
+
+	// accept connections on the listening socket until stopRequested is set (e.g. by a signal handler), then stop reading from all connections.
+	// The requests queued at that time are still decoded and answered, the destructor waits for them
+	void run(int listenFd, const volatile std::sig_atomic_t& stopRequested);
+
+	ServerStats getStats() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// socket of a client, closed when the reading thread and all queued requests are done with it.
+	// If sending to the client fails or times out, the socket is shut down, so the reading thread ends and further responses fail immediately
+	struct Connection
+	{
+		int fd = -1;
+		std::mutex sendMutex; // responses of a batch are sent from several threads
+		std::atomic<bool> done; // set when the reading thread finished
+		std::thread reader;
+
+		explicit Connection(int fd) :fd(fd), done(false) {}
+		~Connection();
+	};
+
+	struct QueuedRequest
+	{
+		DecodeRequest request;
+		std::shared_ptr<Connection> connection;
+		Clock::time_point receiveTime;
+	};
+
+	std::vector<std::shared_ptr<LanguageModel>> m_lms;
+	Config m_config;
+	ThreadPool m_threadPool;
+
+	// requests waiting to be decoded
+	std::deque<QueuedRequest> m_queue;
+	mutable std::mutex m_queueMutex;
+	std::condition_variable m_queueChanged;
+	bool m_stop = false;
+	std::thread m_batchThread;
+
+	// connections whose reading thread is running or not joined yet
+	std::list<std::shared_ptr<Connection>> m_connections;
+
+	// statistics, the latencies of the most recent requests are kept in a ring buffer
+	mutable std::mutex m_statsMutex;
+	ServerStats m_stats;
+	uint64_t m_numBatchedRequests = 0;
+	std::vector<double> m_latencies;
+	std::vector<double> m_queueTimes;
+	size_t m_nextLatencyIdx = 0;
+
+	void readRequests(const std::shared_ptr<Connection>& connection);
+	void batchRequests();
+	void decodeBatch(std::vector<QueuedRequest>& batch);
+	DecodeResponse decode(const DecodeRequest& request) const;
+	void sendResponse(Connection& connection, const DecodeResponse& response);
+	void addLatency(double latencyMs, double queueMs, bool isError);
+	void joinFinishedConnections(bool all);
+};
@@ -0,0 +1,439 @@
+#include "Protocol.hpp"
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+
+namespace
+{
+	// appends values to a payload
+	class Writer
+	{
+	public:
+		template<class T>
+		void put(const T& val)
+		{
+			const char* bytes = reinterpret_cast<const char*>(&val);
+			m_payload.insert(m_payload.end(), bytes, bytes + sizeof(T));
+		}
+
+		// number of elements followed by the elements
+		template<class T>
+		void putArray(const T* data, size_t size)
+		{
+			put(static_cast<uint32_t>(size));
+			const char* bytes = reinterpret_cast<const char*>(data);
+			m_payload.insert(m_payload.end(), bytes, bytes + size * sizeof(T));
+		}
+
+		std::vector<char>& getPayload() { return m_payload; }
+
+	private:
+		std::vector<char> m_payload;
+	};
+
+
+	// reads values from a payload in the order they were written
+	class Reader
+	{
+	public:
+		explicit Reader(const std::vector<char>& payload) :m_payload(payload) {}
+
+		template<class T>
+		T get()
+		{
+			T val;
+			std::memcpy(&val, take(sizeof(T)), sizeof(T));
+			return val;
+		}
+
+		template<class T>
+		void getArray(std::vector<T>& res)
+		{
+			const size_t size = get<uint32_t>();
+			if (size > (m_payload.size() - m_pos) / sizeof(T))
+			{
+				throw std::runtime_error("malformed message: array exceeds payload");
+			}
+			res.resize(size);
+			if (size > 0)
+			{
+				std::memcpy(&res[0], take(size * sizeof(T)), size * sizeof(T));
+			}
+		}
+
+		// all values must be read
+		void finish() const
+		{
+			if (m_pos != m_payload.size())
+			{
+				throw std::runtime_error("malformed message: unexpected data at end of payload");
+			}
+		}
+
+	private:
+		const std::vector<char>& m_payload;
+		size_t m_pos = 0;
+
+		const char* take(size_t numBytes)
+		{
+			if (numBytes > m_payload.size() - m_pos)
+			{
+				throw std::runtime_error("malformed message: payload too short");
+			}
+			const char* res = m_payload.data() + m_pos;
+			m_pos += numBytes;
+			return res;
+		}
+	};
+
+
+	std::runtime_error socketError(const std::string& what)
+	{
+		return std::runtime_error(what + ": " + std::strerror(errno));
+	}
+
+
+	void sendAll(int fd, const char* data, size_t size)
+	{
+		while (size > 0)
+		{
+#ifdef MSG_NOSIGNAL
+			const ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL); // closed peer gives an error instead of SIGPIPE
+#else
+			const ssize_t n = ::send(fd, data, size, 0);
+#endif
+			if (n < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (n <= 0)
+			{
+				throw socketError("can not send message");
+			}
+			data += n;
+			size -= static_cast<size_t>(n);
+		}
+	}
+
+
+	// returns the number of bytes received, which is less than size only if the peer closed the socket
+	size_t receiveAll(int fd, char* data, size_t size)
+	{
+		size_t numReceived = 0;
+		while (numReceived < size)
+		{
+			const ssize_t n = ::recv(fd, data + numReceived, size - numReceived, 0);
+			if (n < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (n < 0)
+			{
+				throw socketError("can not receive message");
+			}
+			if (n == 0)
+			{
+				break;
+			}
+			numReceived += static_cast<size_t>(n);
+		}
+		return numReceived;
+	}
+
+
+	// split address into "unix" or "tcp" and the path or port
+	void parseAddress(const std::string& address, std::string& kind, std::string& location)
+	{
+		const size_t sep = address.find(':');
+		if (sep != std::string::npos)
+		{
+			kind = address.substr(0, sep);
+			location = address.substr(sep + 1);
+		}
+		if (sep == std::string::npos || (kind != "unix" && kind != "tcp") || location.empty())
+		{
+			throw std::invalid_argument("address must be unix:PATH or tcp:PORT, got " + address);
+		}
+	}
+
+
+	sockaddr_un getUnixAddress(const std::string& path)
+	{
+		sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path))
+		{
+			throw std::invalid_argument("path of Unix domain socket is too long: " + path);
+		}
+		std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+		return addr;
+	}
+
+
+	// true if path is a Unix domain socket on which no server accepts connections, e.g. left over from a server which was killed
+	bool isStaleSocket(const std::string& path, const sockaddr_un& addr)
+	{
+		struct stat info;
+		if (::lstat(path.c_str(), &info) != 0 || !S_ISSOCK(info.st_mode))
+		{
+			return false;
+		}
+
+		const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+		{
+			return false;
+		}
+		const bool refused = ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 && errno == ECONNREFUSED;
+		::close(fd);
+		return refused;
+	}
+
+
+	sockaddr_in getTcpAddress(const std::string& port)
+	{
+		sockaddr_in addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(static_cast<uint16_t>(std::stoi(port)));
+		return addr;
+	}
+}
+
+
+std::vector<char> serialize(const DecodeRequest& msg)
+{
+	Writer writer;
+	writer.put(msg.id);
+	writer.put(msg.lmIdx);
+	writer.put(msg.lmType);
+	writer.put(msg.beamWidth);
+	writer.put(msg.logDomain);
+	writer.put(msg.pruneMinProb);
+	writer.put(msg.pruneTopN);
+	writer.put(msg.blankThreshold);
+	writer.put(msg.numT);
+	writer.put(msg.numC);
+	writer.putArray(msg.mat.data(), msg.mat.size());
+	return std::move(writer.getPayload());
+}
+
+
+std::vector<char> serialize(const DecodeResponse& msg)
+{
+	Writer writer;
+	writer.put(msg.id);
+	writer.putArray(msg.error.data(), msg.error.size());
+	writer.putArray(msg.text.data(), msg.text.size());
+	writer.put(msg.queueMs);
+	writer.put(msg.decodeMs);
+	return std::move(writer.getPayload());
+}
+
+
+std::vector<char> serialize(const ServerStats& msg)
+{
+	Writer writer;
+	writer.put(msg.queueDepth);
+	writer.put(msg.maxQueueDepth);
+	writer.put(msg.numConnections);
+	writer.put(msg.numRequests);
+	writer.put(msg.numErrors);
+	writer.put(msg.numBatches);
+	writer.put(msg.meanBatchSize);
+	writer.put(msg.meanQueueMs);
+	writer.put(msg.p50LatencyMs);
+	writer.put(msg.p90LatencyMs);
+	writer.put(msg.p99LatencyMs);
+	writer.put(msg.maxLatencyMs);
+	return std::move(writer.getPayload());
+}
+
+
+void parse(const std::vector<char>& payload, DecodeRequest& msg)
+{
+	Reader reader(payload);
+	msg.id = reader.get<uint64_t>();
+	msg.lmIdx = reader.get<uint32_t>();
+	msg.lmType = reader.get<uint32_t>();
+	msg.beamWidth = reader.get<uint32_t>();
+	msg.logDomain = reader.get<uint8_t>();
+	msg.pruneMinProb = reader.get<double>();
+	msg.pruneTopN = reader.get<uint32_t>();
+	msg.blankThreshold = reader.get<double>();
+	msg.numT = reader.get<uint32_t>();
+	msg.numC = reader.get<uint32_t>();
+	reader.getArray(msg.mat);
+	reader.finish();
+	if (msg.mat.size() != static_cast<uint64_t>(msg.numT) * msg.numC)
+	{
+		throw std::runtime_error("malformed message: matrix size does not match its dimensions");
+	}
+}
+
+
+void parse(const std::vector<char>& payload, DecodeResponse& msg)
+{
+	Reader reader(payload);
+	msg.id = reader.get<uint64_t>();
+	std::vector<char> error;
+	reader.getArray(error);
+	msg.error.assign(error.begin(), error.end());
+	reader.getArray(msg.text);
+	msg.queueMs = reader.get<double>();
+	msg.decodeMs = reader.get<double>();
+	reader.finish();
+}
+
+
+void parse(const std::vector<char>& payload, ServerStats& msg)
+{
+	Reader reader(payload);
+	msg.queueDepth = reader.get<uint64_t>();
+	msg.maxQueueDepth = reader.get<uint64_t>();
+	msg.numConnections = reader.get<uint64_t>();
+	msg.numRequests = reader.get<uint64_t>();
+	msg.numErrors = reader.get<uint64_t>();
+	msg.numBatches = reader.get<uint64_t>();
+	msg.meanBatchSize = reader.get<double>();
+	msg.meanQueueMs = reader.get<double>();
+	msg.p50LatencyMs = reader.get<double>();
+	msg.p90LatencyMs = reader.get<double>();
+	msg.p99LatencyMs = reader.get<double>();
+	msg.maxLatencyMs = reader.get<double>();
+	reader.finish();
+}
+
+
+void sendMessage(int fd, MessageType type, const std::vector<char>& payload)
+{
+	if (payload.size() > maxPayloadSize)
+	{
+		throw std::runtime_error("message too large");
+	}
+
+	// header and payload are sent in one piece, so the frame is not split into several packets
+	std::vector<char> frame(2 * sizeof(uint32_t) + payload.size());
+	const uint32_t header[2] = { static_cast<uint32_t>(payload.size()), static_cast<uint32_t>(type) };
+	std::memcpy(frame.data(), header, sizeof(header));
+	if (!payload.empty())
+	{
+		std::memcpy(frame.data() + sizeof(header), payload.data(), payload.size());
+	}
+	sendAll(fd, frame.data(), frame.size());
+}
+
+
+bool receiveMessage(int fd, MessageType& type, std::vector<char>& payload)
+{
+	uint32_t header[2];
+	const size_t numReceived = receiveAll(fd, reinterpret_cast<char*>(header), sizeof(header));
+	if (numReceived == 0)
+	{
+		return false;
+	}
+	if (numReceived != sizeof(header))
+	{
+		throw std::runtime_error("connection closed within message");
+	}
+	if (header[0] > maxPayloadSize)
+	{
+		throw std::runtime_error("message too large");
+	}
+
+	type = static_cast<MessageType>(header[1]);
+	payload.resize(header[0]);
+	if (!payload.empty() && receiveAll(fd, payload.data(), payload.size()) != payload.size())
+	{
+		throw std::runtime_error("connection closed within message");
+	}
+	return true;
+}
+
+
+int listenOn(const std::string& address)
+{
+	std::string kind, location;
+	parseAddress(address, kind, location);
+
+	const int fd = ::socket(kind == "unix" ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		throw socketError("can not create socket");
+	}
+
+	int res = 0;
+	if (kind == "unix")
+	{
+		// only a stale socket is replaced. Binding fails with "address in use" if any other file (or the socket of a running server) is at the path
+		const sockaddr_un addr = getUnixAddress(location);
+		if (isStaleSocket(location, addr))
+		{
+			::unlink(location.c_str());
+		}
+		res = ::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+	}
+	else
+	{
+		const int reuse = 1;
+		::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		const sockaddr_in addr = getTcpAddress(location);
+		res = ::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+	}
+
+	if (res != 0 || ::listen(fd, SOMAXCONN) != 0)
+	{
+		const auto error = socketError("can not listen on " + address);
+		::close(fd);
+		throw error;
+	}
+	return fd;
+}
+
+
+int connectTo(const std::string& address)
+{
+	std::string kind, location;
+	parseAddress(address, kind, location);
+
+	const int fd = ::socket(kind == "unix" ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		throw socketError("can not create socket");
+	}
+
+	int res = 0;
+	if (kind == "unix")
+	{
+		const sockaddr_un addr = getUnixAddress(location);
+		res = ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+	}
+	else
+	{
+		const sockaddr_in addr = getTcpAddress(location);
+		res = ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+
+		// requests are small and latency matters, so they are not delayed by Nagle's algorithm
+		const int noDelay = 1;
+		::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+	}
+
+	if (res != 0)
+	{
+		const auto error = socketError("can not connect to " + address);
+		::close(fd);
+		throw error;
+	}
+	return fd;
+}
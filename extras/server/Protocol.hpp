@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <cstddef>
+
+
+// messages exchanged between the decode server and its clients.
+// Each message is sent as a frame: payload size (uint32), message type (uint32), payload.
+// Values are written in the byte order of the machine, as server and clients run on the same machine
+enum class MessageType : uint32_t
+{
+	DecodeRequest = 1
+	, DecodeResponse = 2
+	, StatsRequest = 3 // empty payload
+	, StatsResponse = 4
+};
+
+
+// matrix of one input and the parameters to decode it
+struct DecodeRequest
+{
+	uint64_t id = 0; // chosen by the client and sent back with the response, responses are sent in the order in which decoding finishes
+	uint32_t lmIdx = 0; // index of the LM in the order in which the LMs are given to the server
+	uint32_t lmType = 0; // LanguageModelType: 0=Words, 1=NGrams, 2=NGramsForecast, 3=NGramsForecastAndSample
+	uint32_t beamWidth = 25;
+	uint8_t logDomain = 0;
+	double pruneMinProb = 0.0;
+	uint32_t pruneTopN = 0;
+	double blankThreshold = 0.0;
+	uint32_t numT = 0;
+	uint32_t numC = 0; // number of chars plus 1 (blank)
+	std::vector<float> mat; // TxC, row-major, softmax already applied
+};
+
+
+// decoded text, or an error message if the request could not be decoded
+struct DecodeResponse
+{
+	uint64_t id = 0;
+	std::string error; // empty if decoded
+	std::vector<uint32_t> text;
+	double queueMs = 0.0; // time from receiving the request until decoding started
+	double decodeMs = 0.0;
+};
+
+
+// state of the server since it was started, latencies are taken over the most recent requests
+struct ServerStats
+{
+	uint64_t queueDepth = 0; // requests waiting to be decoded
+	uint64_t maxQueueDepth = 0;
+	uint64_t numConnections = 0; // open connections
+	uint64_t numRequests = 0; // decoded requests, including errors
+	uint64_t numErrors = 0; // requests answered with an error, including requests rejected because the queue was full
+	uint64_t numBatches = 0;
+	double meanBatchSize = 0.0;
+	double meanQueueMs = 0.0;
+	double p50LatencyMs = 0.0; // latency from receiving a request until its response is sent
+	double p90LatencyMs = 0.0;
+	double p99LatencyMs = 0.0;
+	double maxLatencyMs = 0.0;
+};
+
+
+// payloads larger than this are rejected
+const uint32_t maxPayloadSize = 1u << 28;
+
+// convert message to payload and back, parsing throws std::runtime_error if the payload is malformed
+std::vector<char> serialize(const DecodeRequest& msg);
+std::vector<char> serialize(const DecodeResponse& msg);
+std::vector<char> serialize(const ServerStats& msg);
+void parse(const std::vector<char>& payload, DecodeRequest& msg);
+void parse(const std::vector<char>& payload, DecodeResponse& msg);
+void parse(const std::vector<char>& payload, ServerStats& msg);
+
+// send frame to socket, throws std::runtime_error if the socket is closed
+void sendMessage(int fd, MessageType type, const std::vector<char>& payload);
+
+// receive frame from socket. Returns false if the peer closed the socket before the frame, throws std::runtime_error on errors
+bool receiveMessage(int fd, MessageType& type, std::vector<char>& payload);
+
+// sockets given by an address "unix:PATH" (Unix domain socket) or "tcp:PORT" (TCP on localhost), throw std::runtime_error on errors.
+// A Unix domain socket left over from a previous server (no server accepts connections on it) is replaced, other files at the path give "address in use"
+int listenOn(const std::string& address);
+int connectTo(const std::string& address);
@@ -0,0 +1,139 @@
+#include "DecodeClient.hpp"
+#include "Protocol.hpp"
+#include "../../cpp/DataLoader.hpp"
+#include "../bench/Percentile.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <cstddef>
+
+
+namespace
+{
+	double elapsedMs(std::chrono::steady_clock::time_point startTime)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	}
+}
+
+
+// load generator for the decode server: for an increasing number of concurrent clients, each client sends the samples of the dataset
+// one after the other and waits for each response. Writes one CSV line per number of clients to stdout, and additionally to the file given as third argument
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		std::cerr << "usage: benchServer ADDRESS DIR [file.csv]\n"
+			<< "  the server must have the LM of DIR (e.g. the directory itself) at index 0\n";
+		return 1;
+	}
+	const std::string address = argv[1];
+	const std::string dir = argv[2];
+	const std::vector<size_t> numClientsList = { 1, 2, 4, 8, 16, 32 };
+	const size_t numRequestsPerClient = 100;
+	const uint32_t beamWidth = 25;
+	const LanguageModelType lmType = LanguageModelType::NGrams;
+
+	try
+	{
+		// requests are created once and reused
+		DataLoader loader(dir, 1, lmType);
+		std::vector<DecodeRequest> requests;
+		while (loader.hasNext())
+		{
+			DecodeRequest request = DecodeClient::createRequest(requests.size(), loader.getNext().mat.getView());
+			request.lmType = static_cast<uint32_t>(lmType);
+			request.beamWidth = beamWidth;
+			requests.push_back(std::move(request));
+		}
+		if (requests.empty())
+		{
+			throw std::runtime_error("no samples found in " + dir);
+		}
+
+		std::ostringstream csv;
+		csv << "clients;requests;errors;p50 ms;p90 ms;p99 ms;max ms;requests per s;mean batch size;max queue depth\n";
+		std::cout << csv.str() << std::flush;
+
+		DecodeClient statsClient(address);
+		for (const auto numClients : numClientsList)
+		{
+			// clients connect before the measurement starts
+			std::vector<std::unique_ptr<DecodeClient>> clients;
+			for (size_t i = 0; i < numClients; ++i)
+			{
+				clients.emplace_back(new DecodeClient(address));
+			}
+			const ServerStats statsBefore = statsClient.getStats();
+
+			std::vector<double> latencies;
+			size_t numErrors = 0;
+			std::mutex resultMutex;
+			std::vector<std::thread> threads;
+			const auto startTime = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < numClients; ++i)
+			{
+				threads.emplace_back([&, i]()
+				{
+					std::vector<double> clientLatencies;
+					size_t clientErrors = 0;
+					for (size_t r = 0; r < numRequestsPerClient; ++r)
+					{
+						const auto requestStartTime = std::chrono::steady_clock::now();
+						const DecodeResponse response = clients[i]->decode(requests[(i + r) % requests.size()]);
+						clientLatencies.push_back(elapsedMs(requestStartTime));
+						clientErrors += response.error.empty() ? 0 : 1;
+					}
+					std::lock_guard<std::mutex> lock(resultMutex);
+					latencies.insert(latencies.end(), clientLatencies.begin(), clientLatencies.end());
+					numErrors += clientErrors;
+				});
+			}
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+			const double totalMs = elapsedMs(startTime);
+			const ServerStats statsAfter = statsClient.getStats();
+			std::sort(latencies.begin(), latencies.end());
+
+			// batch size of the requests of this run
+			const size_t numBatches = statsAfter.numBatches - statsBefore.numBatches;
+			const double meanBatchSize = numBatches > 0 ? double(statsAfter.numRequests - statsBefore.numRequests) / numBatches : 0.0;
+
+			std::ostringstream line;
+			line << numClients << ";" << latencies.size() << ";" << numErrors << ";";
+			line << std::fixed << std::setprecision(3) << getPercentile(latencies, 50) << ";" << getPercentile(latencies, 90) << ";" << getPercentile(latencies, 99) << ";" << latencies.back() << ";";
+			line << std::setprecision(1) << latencies.size() / (totalMs / 1000.0) << ";" << std::setprecision(2) << meanBatchSize << ";" << statsAfter.maxQueueDepth << "\n";
+			csv << line.str();
+			std::cout << line.str() << std::flush;
+		}
+
+		if (argc > 3)
+		{
+			std::ofstream file(argv[3]);
+			file << csv.str();
+			if (!file)
+			{
+				std::cerr << "can not write file " << argv[3] << "\n";
+				return 1;
+			}
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "error: " << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
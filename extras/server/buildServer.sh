@@ -0,0 +1,11 @@
+#!/bin/bash
+
+
+# build decode server, test client and load generator, the executables are written to the current directory
+CPP=../../cpp
+CORE="$CPP/WordBeamSearch.cpp $CPP/PrefixTree.cpp $CPP/BinaryFile.cpp $CPP/LanguageModel.cpp $CPP/Beam.cpp $CPP/BeamArena.cpp $CPP/StreamDecoder.cpp $CPP/DataLoader.cpp $CPP/MatrixCSV.cpp"
+
+g++ -Wall -O2 -DNDEBUG --std=c++11 -o wbsServer wbsServer.cpp DecodeServer.cpp Protocol.cpp $CORE $CPP/ThreadPool.cpp -lpthread
+g++ -Wall -O2 -DNDEBUG --std=c++11 -o wbsClient wbsClient.cpp DecodeClient.cpp Protocol.cpp $CORE -lpthread
+g++ -Wall -O2 -DNDEBUG --std=c++11 -o benchServer benchServer.cpp DecodeClient.cpp Protocol.cpp $CORE -lpthread
+g++ -Wall -O2 --std=c++11 -o testServer testServer.cpp DecodeServer.cpp DecodeClient.cpp Protocol.cpp $CORE $CPP/ThreadPool.cpp -lpthread
@@ -0,0 +1,194 @@
+#include "DecodeServer.hpp"
+#include "DecodeClient.hpp"
+#include "Protocol.hpp"
+#include "../../cpp/LanguageModel.hpp"
+#include <cassert>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <csignal>
+#include <unistd.h>
+
+
+namespace
+{
+	// LM with the chars "ab. " and a request with T time-steps for it, decoded to "a"
+	std::shared_ptr<LanguageModel> createLm()
+	{
+		return std::make_shared<LanguageModel>("a b.", "ab. ", "ab", LanguageModelType::Words);
+	}
+
+
+	DecodeRequest createRequest(uint64_t id, uint32_t numT)
+	{
+		DecodeRequest request;
+		request.id = id;
+		request.beamWidth = 2;
+		request.numT = numT;
+		request.numC = 5;
+		request.mat.assign(numT * request.numC, 0.0f);
+		for (uint32_t t = 0; t < numT; ++t)
+		{
+			request.mat[t * request.numC + (t == 0 ? 0 : 4)] = 1.0f; // "a", followed by blanks
+		}
+		return request;
+	}
+
+
+	// server running on its own thread, stopped and destroyed when going out of scope
+	class TestServer
+	{
+	public:
+		TestServer(const std::string& address, const DecodeServer::Config& config)
+		:m_listenFd(listenOn(address))
+		,m_server(new DecodeServer({ createLm() }, config))
+		{
+			m_thread = std::thread([this] { m_server->run(m_listenFd, m_stopRequested); });
+		}
+
+		~TestServer()
+		{
+			stop();
+			::close(m_listenFd);
+		}
+
+		// stop accepting requests, queued requests are still answered
+		void stop()
+		{
+			if (m_server)
+			{
+				m_stopRequested = 1;
+				m_thread.join();
+				m_server.reset();
+			}
+		}
+
+	private:
+		volatile std::sig_atomic_t m_stopRequested = 0;
+		int m_listenFd;
+		std::unique_ptr<DecodeServer> m_server;
+		std::thread m_thread;
+	};
+}
+
+
+// tests of the decode server, run with assertions enabled
+int main()
+{
+	std::signal(SIGPIPE, SIG_IGN);
+	const std::string address = "unix:/tmp/wbsTestServer_" + std::to_string(::getpid()) + ".sock";
+	std::cout << "TESTS: begin\n";
+
+	// a client which sends requests but never reads the responses is dropped after the send timeout, other clients are still served.
+	// Without the timeout, the stalled client blocks the server and this test does not finish
+	{
+		DecodeServer::Config config;
+		config.numThreads = 2;
+		config.maxQueueSize = 64;
+		config.sendTimeoutMs = 200.0;
+		TestServer server(address, config);
+
+		DecodeClient stalledClient(address);
+		bool dropped = false;
+		try
+		{
+			const DecodeRequest request = createRequest(0, 100);
+			for (size_t i = 0; i < 1000000; ++i)
+			{
+				stalledClient.send(request);
+			}
+		}
+		catch (const std::exception&)
+		{
+			dropped = true;
+		}
+		assert(dropped);
+
+		// the requests of the dropped client which are still queued may fill the queue for a moment
+		DecodeClient client(address);
+		DecodeResponse response = client.decode(createRequest(1, 3));
+		for (size_t i = 0; i < 100 && response.error == "queue is full"; ++i)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			response = client.decode(createRequest(1, 3));
+		}
+		assert(response.id == 1 && response.error.empty() && response.text == std::vector<uint32_t>{ 0 });
+	}
+	::unlink(address.substr(5).c_str());
+
+	// requests which are queued when the server stops are still decoded and answered
+	{
+		DecodeServer::Config config;
+		config.maxWaitMs = 60000.0; // requests stay in the queue until the server stops
+		TestServer server(address, config);
+
+		DecodeClient client(address);
+		const size_t numRequests = 3;
+		for (size_t i = 0; i < numRequests; ++i)
+		{
+			client.send(createRequest(i, 3));
+		}
+		DecodeClient statsClient(address);
+		for (size_t i = 0; i < 1000 && statsClient.getStats().queueDepth < numRequests; ++i)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		assert(statsClient.getStats().queueDepth == numRequests);
+
+		server.stop();
+		std::vector<bool> answered(numRequests, false);
+		for (size_t i = 0; i < numRequests; ++i)
+		{
+			const DecodeResponse response = client.receive();
+			assert(response.id < numRequests && response.error.empty() && response.text == std::vector<uint32_t>{ 0 });
+			answered[response.id] = true;
+		}
+		assert(std::find(answered.begin(), answered.end(), false) == answered.end());
+	}
+	::unlink(address.substr(5).c_str());
+
+	// only a stale socket file is replaced when listening, other files and the socket of a running server are kept
+	{
+		const std::string path = address.substr(5);
+		std::ofstream(path) << "not a socket";
+		bool thrown = false;
+		try
+		{
+			listenOn(address);
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown && std::ifstream(path).good());
+		::unlink(path.c_str());
+
+		const int listenFd = listenOn(address);
+		thrown = false;
+		try
+		{
+			listenOn(address);
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown);
+		::close(connectTo(address));
+		::close(listenFd);
+
+		// the socket file is left over after closing the listening socket
+		::close(listenOn(address));
+		::unlink(path.c_str());
+	}
+
+	std::cout << "TESTS: end\n";
+	return 0;
+}
@@ -0,0 +1,166 @@
+#include "DecodeClient.hpp"
+#include "Protocol.hpp"
+#include "../../cpp/DataLoader.hpp"
+#include "../../cpp/WordBeamSearch.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <exception>
+#include <stdexcept>
+#include <stdint.h>
+
+
+namespace
+{
+	void printUsage()
+	{
+		std::cerr << "usage: wbsClient ADDRESS DIR [--lm IDX] [--lm-type TYPE] [--beam-width N] [--smoothing K]\n"
+			<< "       wbsClient ADDRESS --stats\n"
+			<< "  decodes the samples mat_X.csv of DIR with the server and checks that the results equal the results of decoding them locally.\n"
+			<< "  The LM with index IDX on the server must be created from DIR with the same smoothing K\n";
+	}
+
+
+	LanguageModelType getLmType(const std::string& name)
+	{
+		const std::map<std::string, LanguageModelType> lmTypes = {
+			{ "Words", LanguageModelType::Words },
+			{ "NGrams", LanguageModelType::NGrams },
+			{ "NGramsForecast", LanguageModelType::NGramsForecast },
+			{ "NGramsForecastAndSample", LanguageModelType::NGramsForecastAndSample } };
+		const auto it = lmTypes.find(name);
+		if (it == lmTypes.end())
+		{
+			throw std::invalid_argument("unknown LM type " + name);
+		}
+		return it->second;
+	}
+
+
+	void printStats(const ServerStats& stats)
+	{
+		std::cout << "queue depth: " << stats.queueDepth << " (max " << stats.maxQueueDepth << ")\n"
+			<< "connections: " << stats.numConnections << "\n"
+			<< "requests: " << stats.numRequests << " (errors " << stats.numErrors << ")\n"
+			<< "batches: " << stats.numBatches << " (mean size " << stats.meanBatchSize << ")\n"
+			<< "mean queue time: " << stats.meanQueueMs << "ms\n"
+			<< "latency: p50 " << stats.p50LatencyMs << "ms, p90 " << stats.p90LatencyMs << "ms, p99 " << stats.p99LatencyMs << "ms, max " << stats.maxLatencyMs << "ms\n";
+	}
+}
+
+
+// test client of the decode server
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		printUsage();
+		return 1;
+	}
+
+	try
+	{
+		const std::string address = argv[1];
+		DecodeClient client(address);
+		if (std::string(argv[2]) == "--stats")
+		{
+			printStats(client.getStats());
+			return 0;
+		}
+
+		const std::string dir = argv[2];
+		uint32_t lmIdx = 0;
+		LanguageModelType lmType = LanguageModelType::NGrams;
+		uint32_t beamWidth = 25;
+		double addK = 0.0;
+		for (int i = 3; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			if (i + 1 >= argc)
+			{
+				printUsage();
+				return 1;
+			}
+			if (arg == "--lm")
+			{
+				lmIdx = static_cast<uint32_t>(std::stoul(argv[++i]));
+			}
+			else if (arg == "--lm-type")
+			{
+				lmType = getLmType(argv[++i]);
+			}
+			else if (arg == "--beam-width")
+			{
+				beamWidth = static_cast<uint32_t>(std::stoul(argv[++i]));
+			}
+			else if (arg == "--smoothing")
+			{
+				addK = std::stod(argv[++i]);
+			}
+			else
+			{
+				printUsage();
+				return 1;
+			}
+		}
+
+		// send all samples at once, so the server can batch them
+		DataLoader loader(dir, 1, LanguageModelType::NGrams, addK);
+		const auto lm = loader.getLanguageModel();
+		std::vector<DecodeRequest> requests;
+		std::vector<std::vector<uint32_t>> gts;
+		while (loader.hasNext())
+		{
+			const auto data = loader.getNext();
+			DecodeRequest request = DecodeClient::createRequest(requests.size(), data.mat.getView());
+			request.lmIdx = lmIdx;
+			request.lmType = static_cast<uint32_t>(lmType);
+			request.beamWidth = beamWidth;
+			client.send(request);
+			requests.push_back(std::move(request));
+			gts.push_back(data.gt);
+		}
+
+		// responses arrive in the order in which decoding finishes
+		size_t numFailed = 0;
+		for (size_t i = 0; i < requests.size(); ++i)
+		{
+			const DecodeResponse response = client.receive();
+			if (response.id >= requests.size())
+			{
+				throw std::runtime_error("response to unknown request " + std::to_string(response.id));
+			}
+			std::cout << "Sample: " << response.id << "\n";
+			if (!response.error.empty())
+			{
+				std::cout << "Error:        " << response.error << "\n\n";
+				++numFailed;
+				continue;
+			}
+
+			// the server decodes the float32 matrix of the request, so the same matrix is decoded locally
+			const DecodeRequest& request = requests[response.id];
+			const MatrixView<float> mat(request.mat.data(), request.numT, request.numC, static_cast<ptrdiff_t>(request.numC));
+			const bool isEqual = wordBeamSearch(mat, beamWidth, lm, lmType) == response.text;
+			numFailed += isEqual ? 0 : 1;
+			std::cout << "Result:       \"" << lm->labelToUtf8(response.text) << "\"" << (isEqual ? "" : " (differs from local result)") << "\n";
+			std::cout << "Ground Truth: \"" << lm->labelToUtf8(gts[response.id]) << "\"\n";
+			std::cout << "Time:         queue " << response.queueMs << "ms, decode " << response.decodeMs << "ms\n\n";
+		}
+
+		printStats(client.getStats());
+		if (numFailed > 0)
+		{
+			std::cerr << numFailed << " of " << requests.size() << " samples failed\n";
+			return 1;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "error: " << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
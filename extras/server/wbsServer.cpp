@@ -0,0 +1,133 @@
+#include "DecodeServer.hpp"
+#include "Protocol.hpp"
+#include "../../cpp/DataLoader.hpp"
+#include "../../cpp/LanguageModel.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <exception>
+#include <csignal>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace
+{
+	volatile std::sig_atomic_t stopRequested = 0;
+
+	void requestStop(int)
+	{
+		stopRequested = 1;
+	}
+
+
+	void printUsage()
+	{
+		std::cerr << "usage: wbsServer [--listen ADDRESS] [--threads N] [--max-batch N] [--max-wait-ms MS] [--max-queue N] [--send-timeout-ms MS] [--smoothing K] LM [LM ...]\n"
+			<< "  ADDRESS: unix:PATH or tcp:PORT (localhost), default unix:/tmp/wbs.sock\n"
+			<< "  LM: binary LM file written by save_lm, or directory with corpus.txt, chars.txt and wordChars.txt (LM created with add-k smoothing K)\n"
+			<< "  the LMs are referenced by their index (0, 1, ...) in the decode requests\n";
+	}
+
+
+	bool isDirectory(const std::string& path)
+	{
+		struct stat info;
+		return ::stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+	}
+}
+
+
+// decode server: loads the LMs once and decodes the requests of local clients until SIGINT or SIGTERM
+int main(int argc, char* argv[])
+{
+	std::string address = "unix:/tmp/wbs.sock";
+	DecodeServer::Config config;
+	double addK = 0.0;
+	std::vector<std::string> lmPaths;
+
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--listen" && hasValue)
+			{
+				address = argv[++i];
+			}
+			else if (arg == "--threads" && hasValue)
+			{
+				config.numThreads = std::stoul(argv[++i]);
+			}
+			else if (arg == "--max-batch" && hasValue)
+			{
+				config.maxBatchSize = std::stoul(argv[++i]);
+			}
+			else if (arg == "--max-wait-ms" && hasValue)
+			{
+				config.maxWaitMs = std::stod(argv[++i]);
+			}
+			else if (arg == "--max-queue" && hasValue)
+			{
+				config.maxQueueSize = std::stoul(argv[++i]);
+			}
+			else if (arg == "--send-timeout-ms" && hasValue)
+			{
+				config.sendTimeoutMs = std::stod(argv[++i]);
+			}
+			else if (arg == "--smoothing" && hasValue)
+			{
+				addK = std::stod(argv[++i]);
+			}
+			else if (!arg.empty() && arg[0] != '-')
+			{
+				lmPaths.push_back(arg);
+			}
+			else
+			{
+				printUsage();
+				return 1;
+			}
+		}
+		if (lmPaths.empty())
+		{
+			printUsage();
+			return 1;
+		}
+
+		// load LMs, the LMs created from text contain bigrams so that they can be used with all LM types
+		std::vector<std::shared_ptr<LanguageModel>> lms;
+		for (const auto& path : lmPaths)
+		{
+			lms.push_back(isDirectory(path) ? DataLoader(path, 1, LanguageModelType::NGrams, addK).getLanguageModel() : LanguageModel::load(path));
+			std::cout << "LM " << lms.size() - 1 << ": " << path << " (" << lms.back()->getAllChars().size() << " chars)\n";
+		}
+
+		// responses to closed connections give an error instead of terminating the server
+		std::signal(SIGPIPE, SIG_IGN);
+		std::signal(SIGINT, requestStop);
+		std::signal(SIGTERM, requestStop);
+
+		const int listenFd = listenOn(address);
+		{
+			DecodeServer server(lms, config);
+			std::cout << "listening on " << address << std::endl;
+			server.run(listenFd, stopRequested);
+		}
+		::close(listenFd);
+		if (address.compare(0, 5, "unix:") == 0)
+		{
+			::unlink(address.substr(5).c_str());
+		}
+		std::cout << "server stopped\n";
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "error: " << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
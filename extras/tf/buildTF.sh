@@ -19,6 +19,15 @@ else
 fi
 
 
+# collect decoding statistics (logged with VLOG level 1) if the environment variable WBS_STATS=1 is set
+if [ "$WBS_STATS" == "1" ]; then
+	echo "Decoding statistics enabled"
+	STATS="-DWBS_STATS"
+else
+	STATS=""
+fi
+
+
 # get and print TF version
 TF_VERSION=$(python3 -c "import tensorflow as tf ;  print(tf.__version__)")
 echo "Your TF version is $TF_VERSION"
@@ -32,7 +41,7 @@ if [ "$TF_VERSION" == "1.3.0" ]; then
 
 	TF_INC=$(python3 -c 'import tensorflow as tf; print(tf.sysconfig.get_include())')
 
-	g++ -Wall -O2 --std=c++11 -shared -o TFWordBeamSearch.so ../../cpp/TFWordBeamSearch.cpp ../../cpp/main.cpp ../../cpp/WordBeamSearch.cpp ../../cpp/PrefixTree.cpp ../../cpp/Metrics.cpp ../../cpp/MatrixCSV.cpp ../../cpp/LanguageModel.cpp ../../cpp/DataLoader.cpp ../../cpp/Beam.cpp -fPIC -D_GLIBCXX_USE_CXX11_ABI=0 $PARALLEL -I$TF_INC
+	g++ -Wall -O2 --std=c++11 -shared -o TFWordBeamSearch.so ../../cpp/TFWordBeamSearch.cpp ../../cpp/main.cpp ../../cpp/WordBeamSearch.cpp ../../cpp/PrefixTree.cpp ../../cpp/BinaryFile.cpp ../../cpp/Metrics.cpp ../../cpp/MatrixCSV.cpp ../../cpp/LanguageModel.cpp ../../cpp/DataLoader.cpp ../../cpp/Beam.cpp ../../cpp/BeamArena.cpp ../../cpp/StreamDecoder.cpp ../../cpp/ThreadPool.cpp -fPIC -D_GLIBCXX_USE_CXX11_ABI=0 $PARALLEL $STATS -I$TF_INC
 
 
 # compile it for TF1.4
@@ -43,7 +52,7 @@ elif [ "$TF_VERSION" == "1.4.0" ]; then
 	TF_INC=$(python3 -c 'import tensorflow as tf; print(tf.sysconfig.get_include())')
 	TF_LIB=$(python3 -c 'import tensorflow as tf; print(tf.sysconfig.get_lib())')
 
-	g++ -Wall -O2 --std=c++11 -shared -o TFWordBeamSearch.so ../../cpp/TFWordBeamSearch.cpp ../../cpp/main.cpp ../../cpp/WordBeamSearch.cpp ../../cpp/PrefixTree.cpp ../../cpp/Metrics.cpp ../../cpp/MatrixCSV.cpp ../../cpp/LanguageModel.cpp ../../cpp/DataLoader.cpp ../../cpp/Beam.cpp -D_GLIBCXX_USE_CXX11_ABI=0 $PARALLEL -fPIC -I$TF_INC -I$TF_INC/external/nsync/public -L$TF_LIB -ltensorflow_framework
+	g++ -Wall -O2 --std=c++11 -shared -o TFWordBeamSearch.so ../../cpp/TFWordBeamSearch.cpp ../../cpp/main.cpp ../../cpp/WordBeamSearch.cpp ../../cpp/PrefixTree.cpp ../../cpp/BinaryFile.cpp ../../cpp/Metrics.cpp ../../cpp/MatrixCSV.cpp ../../cpp/LanguageModel.cpp ../../cpp/DataLoader.cpp ../../cpp/Beam.cpp ../../cpp/BeamArena.cpp ../../cpp/StreamDecoder.cpp ../../cpp/ThreadPool.cpp -D_GLIBCXX_USE_CXX11_ABI=0 $PARALLEL $STATS -fPIC -I$TF_INC -I$TF_INC/external/nsync/public -L$TF_LIB -ltensorflow_framework
 
 # all other versions (tested for: TF1.5 and TF1.6)
 else
@@ -53,6 +62,6 @@ else
 	TF_LFLAGS=( $(python3 -c 'import tensorflow as tf; print(" ".join(tf.sysconfig.get_link_flags()))') )
 
 
-	g++ -Wall -O2 --std=c++11 -shared -o TFWordBeamSearch.so ../../cpp/TFWordBeamSearch.cpp ../../cpp/main.cpp ../../cpp/WordBeamSearch.cpp ../../cpp/PrefixTree.cpp ../../cpp/Metrics.cpp ../../cpp/MatrixCSV.cpp ../../cpp/LanguageModel.cpp ../../cpp/DataLoader.cpp ../../cpp/Beam.cpp -fPIC ${TF_CFLAGS[@]} ${TF_LFLAGS[@]} -D_GLIBCXX_USE_CXX11_ABI=0 $PARALLEL
+	g++ -Wall -O2 --std=c++11 -shared -o TFWordBeamSearch.so ../../cpp/TFWordBeamSearch.cpp ../../cpp/main.cpp ../../cpp/WordBeamSearch.cpp ../../cpp/PrefixTree.cpp ../../cpp/BinaryFile.cpp ../../cpp/Metrics.cpp ../../cpp/MatrixCSV.cpp ../../cpp/LanguageModel.cpp ../../cpp/DataLoader.cpp ../../cpp/Beam.cpp ../../cpp/BeamArena.cpp ../../cpp/StreamDecoder.cpp ../../cpp/ThreadPool.cpp -fPIC ${TF_CFLAGS[@]} ${TF_LFLAGS[@]} -D_GLIBCXX_USE_CXX11_ABI=0 $PARALLEL $STATS
 
 fi
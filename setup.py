@@ -1,11 +1,17 @@
+import os
+
 from setuptools import Extension
 from setuptools import setup
 
 root = 'cpp/'
-src = [root + fn for fn in ['NPWordBeamSearch.cpp', 'WordBeamSearch.cpp', 'PrefixTree.cpp', 'LanguageModel.cpp', 'Beam.cpp']]
+src = [root + fn for fn in ['NPWordBeamSearch.cpp', 'WordBeamSearch.cpp', 'PrefixTree.cpp', 'BinaryFile.cpp', 'LanguageModel.cpp', 'Beam.cpp',
+                              'BeamArena.cpp', 'StreamDecoder.cpp', 'ThreadPool.cpp']]
 inc = ['cpp/pybind/']
 
-word_beam_search_ext = Extension('word_beam_search', sources=src, include_dirs=inc, language='c++')
+# collect decoding statistics (compute_with_stats) if the environment variable WBS_STATS=1 is set
+macros = [('WBS_STATS', None)] if os.environ.get('WBS_STATS') == '1' else []
+
+word_beam_search_ext = Extension('word_beam_search', sources=src, include_dirs=inc, define_macros=macros, language='c++')
 setup(
     name='word-beam-search',
     version='1.0.1',
@@ -1,17 +1,19 @@
 import codecs
 
 import numpy as np
+import pytest
 from word_beam_search import WordBeamSearch
 
 
-def apply_word_beam_search(mat, corpus, chars, word_chars):
+def apply_word_beam_search(mat, corpus, chars, word_chars, log_domain=False):
     """Decode using word beam search. Result is tuple, first entry is label string, second entry is char string."""
     T, B, C = mat.shape
 
     # decode using the "Words" mode of word beam search with beam width set to 25 and add-k smoothing to 0.0
     assert len(chars) + 1 == C
 
-    wbs = WordBeamSearch(25, 'Words', 0.0, corpus.encode('utf8'), chars.encode('utf8'), word_chars.encode('utf8'))
+    wbs = WordBeamSearch(25, 'Words', 0.0, corpus.encode('utf8'), chars.encode('utf8'), word_chars.encode('utf8'),
+                         log_domain=log_domain)
     label_str = wbs.compute(mat)
 
     # result is string of labels terminated by blank
@@ -72,3 +74,189 @@ def test_real_example():
     print('Label string:', res[0])
     print('Char string:', '"' + res[1] + '"')
     assert res[1] == 'submitt both mental and corporeal, is far beyond any idea'
+
+
+def test_log_domain():
+    """Long input which underflows if probabilities are multiplied, but can be decoded in log-domain."""
+    corpus = 'a ba'
+    chars = 'ab '
+    word_chars = 'ab'
+    mat = np.array([[[0.9, 0.1, 0.0, 0.0]], [[0.0, 0.0, 0.0, 1.0]], [[0.6, 0.4, 0.0, 0.0]]]
+                   + [[[0.0, 0.0, 0.0001, 0.9999]]] * 1000 + [[[0.0, 0.0, 0.0, 1e-5]]] * 100)
+
+    res = apply_word_beam_search(mat, corpus, chars, word_chars, log_domain=True)
+    assert res[1] == 'ba'
+
+
+def test_lm_file(tmp_path):
+    """Store dictionary and LM in a binary file and decode with the LM loaded from this file."""
+    corpus = 'a ba'
+    chars = 'ab '
+    word_chars = 'ab'
+    mat = np.array([[[0.9, 0.1, 0.0, 0.0]], [[0.0, 0.0, 0.0, 1.0]], [[0.6, 0.4, 0.0, 0.0]]])
+
+    lm_file = str(tmp_path / 'lm.bin')
+    WordBeamSearch(25, 'NGrams', 0.0, corpus.encode('utf8'), chars.encode('utf8'), word_chars.encode('utf8')).save_lm(lm_file)
+    wbs = WordBeamSearch(25, 'NGrams', lm_file)
+    assert wbs.compute(mat)[0] == [1, 0]
+
+
+def test_num_threads():
+    """Batch elements decoded in parallel give the same result as decoded one after the other."""
+    data_path = '../data/bentham/'
+    corpus = codecs.open(data_path + 'corpus.txt', 'r', 'utf8').read()
+    chars = codecs.open(data_path + 'chars.txt', 'r', 'utf8').read()
+    word_chars = codecs.open(data_path + 'wordChars.txt', 'r', 'utf8').read()
+    mat = np.concatenate([load_mat(data_path + 'mat_2.csv')] * 8, axis=1)
+
+    args = (25, 'NGrams', 0.0, corpus.encode('utf8'), chars.encode('utf8'), word_chars.encode('utf8'))
+    res_serial = WordBeamSearch(*args).compute(mat)
+    res_parallel = WordBeamSearch(*args, num_threads=4).compute(mat)
+    assert len(res_parallel) == 8
+    assert res_parallel == res_serial
+
+    res_timed, times = WordBeamSearch(*args, num_threads=4).compute_with_times(mat)
+    assert res_timed == res_serial
+    assert len(times) == 8 and all(t > 0 for t in times)
+
+
+def test_seq_lengths():
+    """Padded time-steps are not decoded if the sequence lengths are given."""
+    corpus = 'a ba'
+    chars = 'ab '
+    word_chars = 'ab'
+    mat = np.array([[[0.9, 0.1, 0.0, 0.0], [0.9, 0.1, 0.0, 0.0]], [[0.0, 0.0, 0.0, 1.0], [0.0, 0.0, 0.0, 1.0]],
+                    [[0.6, 0.4, 0.0, 0.0], [0.0, 0.0, 1.0, 0.0]]])  # second element gets " " if time-step 2 is decoded
+
+    wbs = WordBeamSearch(25, 'Words', 0.0, corpus.encode('utf8'), chars.encode('utf8'), word_chars.encode('utf8'))
+    assert wbs.compute(mat) == [[1, 0], [0, 2]]
+    assert wbs.compute(mat, seq_lengths=np.array([3, 2])) == [[1, 0], [0]]
+    assert wbs.compute(mat, seq_lengths=[3, 0]) == [[1, 0], []]
+
+
+def test_float32_and_strided():
+    """float32 and non-contiguous input arrays are decoded like a contiguous float64 array."""
+    data_path = '../data/bentham/'
+    corpus = codecs.open(data_path + 'corpus.txt', 'r', 'utf8').read()
+    chars = codecs.open(data_path + 'chars.txt', 'r', 'utf8').read()
+    word_chars = codecs.open(data_path + 'wordChars.txt', 'r', 'utf8').read()
+    mat_2 = load_mat(data_path + 'mat_2.csv')
+    mat = np.concatenate([mat_2, mat_2[::-1]], axis=1)  # second element is the reversed sequence
+
+    wbs = WordBeamSearch(25, 'Words', 0.0, corpus.encode('utf8'), chars.encode('utf8'), word_chars.encode('utf8'))
+    res = wbs.compute(mat)
+    assert wbs.compute(mat.astype(np.float32)) == res
+
+    # batch-first array transposed to TxBxC without copy
+    mat_batch_first = np.ascontiguousarray(mat.transpose(1, 0, 2)).astype(np.float32)
+    assert wbs.compute(mat_batch_first.transpose(1, 0, 2)) == res
+
+    # reversed batch order via negative stride
+    assert wbs.compute(mat[:, ::-1]) == res[::-1]
+
+    # input which can not be converted to numbers
+    with pytest.raises(TypeError):
+        wbs.compute(np.array([[['x'] * mat.shape[2]]]))
+
+
+def test_char_pruning():
+    """Pruning chars with low probability gives the same result, pruning the best chars changes it."""
+    corpus = 'a ba'
+    chars = 'ab '
+    word_chars = 'ab'
+    mat = np.array([[[0.9, 0.1, 0.0, 0.0]], [[0.0, 0.0, 0.0, 1.0]], [[0.6, 0.4, 0.0, 0.0]]])
+
+    args = (25, 'Words', 0.0, corpus.encode('utf8'), chars.encode('utf8'), word_chars.encode('utf8'))
+    assert WordBeamSearch(*args, prune_min_prob=0.05).compute(mat) == [[1, 0]]
+    assert WordBeamSearch(*args, prune_top_n=2).compute(mat) == [[1, 0]]
+    assert WordBeamSearch(*args, prune_top_n=1).compute(mat) == [[0]]
+    assert WordBeamSearch(*args, prune_min_prob=0.5).compute(mat) == [[0]]
+
+
+def test_blank_threshold():
+    """Runs of blank frames give the same result if they skip the char extension, unless a char in such a frame is needed."""
+    # "b" is decoded from the first two time-steps, although the blank is more probable in each of them
+    corpus = 'a ba'
+    chars = 'ab '
+    word_chars = 'ab'
+    blank_run = [[[0.0001, 0.0002, 0.0001, 0.9996]]] * 50
+    mat = np.array([[[0.0, 0.45, 0.0, 0.55]]] * 2 + blank_run + [[[0.6, 0.4, 0.0, 0.0]]] + blank_run)
+
+    args = (25, 'NGrams', 0.0, corpus.encode('utf8'), chars.encode('utf8'), word_chars.encode('utf8'))
+    res = WordBeamSearch(*args).compute(mat)
+    assert res == [[1, 0]]
+    assert WordBeamSearch(*args, blank_threshold=0.999).compute(mat) == res
+    assert WordBeamSearch(*args, blank_threshold=0.999, log_domain=True).compute(mat) == res
+    assert WordBeamSearch(*args, blank_threshold=0.5).compute(mat) == [[0]]
+
+
+def test_nbest():
+    """N-best list of the final beams with their scores, the best hypothesis is the result of compute."""
+    corpus = 'a ba'
+    chars = 'ab '
+    word_chars = 'ab'
+    mat = np.array([[[0.9, 0.1, 0.0, 0.0]], [[0.0, 0.0, 0.0, 1.0]], [[0.6, 0.4, 0.0, 0.0]]])
+
+    for log_domain in [False, True]:
+        wbs = WordBeamSearch(25, 'NGrams', 0.0, corpus.encode('utf8'), chars.encode('utf8'), word_chars.encode('utf8'),
+                             log_domain=log_domain)
+        res = wbs.compute_nbest(mat, 3)
+        assert len(res) == 1 and 1 < len(res[0]) <= 3
+        assert res[0][0][0] == wbs.compute(mat)[0] == [1, 0]
+        for i, (text, optical_score, textual_score, score) in enumerate(res[0]):
+            combined = optical_score + textual_score if log_domain else optical_score * textual_score
+            assert score == pytest.approx(combined)
+            assert i == 0 or (score <= res[0][i - 1][3] and text != res[0][i - 1][0])
+
+    assert len(wbs.compute_nbest(mat, 1)[0]) == 1
+    assert wbs.compute_nbest(mat, 2, seq_lengths=[0]) == [[([], 0.0, 0.0, 0.0)]]
+    with pytest.raises(ValueError):
+        wbs.compute_nbest(mat, 0)
+
+
+def test_stream():
+    """Input given in chunks of time-steps is decoded like the whole input, the stream can be reused after finalize."""
+    data_path = '../data/bentham/'
+    corpus = codecs.open(data_path + 'corpus.txt', 'r', 'utf8').read()
+    chars = codecs.open(data_path + 'chars.txt', 'r', 'utf8').read()
+    word_chars = codecs.open(data_path + 'wordChars.txt', 'r', 'utf8').read()
+    mat = load_mat(data_path + 'mat_2.csv')
+
+    wbs = WordBeamSearch(25, 'NGrams', 0.0, corpus.encode('utf8'), chars.encode('utf8'), word_chars.encode('utf8'))
+    res = wbs.compute(mat)[0]
+    stream = wbs.create_stream()
+    for chunk_size in [1, 7, mat.shape[0]]:
+        for t in range(0, mat.shape[0], chunk_size):
+            stream.push(mat[t:t + chunk_size, 0, :].astype(np.float32 if chunk_size == 7 else np.float64))
+            stream.partial()
+        assert stream.num_frames == mat.shape[0]
+        assert stream.finalize() == res
+        assert stream.num_frames == 0
+
+    stream.push(mat[:10, 0, :].tolist())
+    with pytest.raises(ValueError):
+        stream.push(mat[:10, 0, :-1])
+    with pytest.raises(TypeError):
+        stream.push(np.array([['x'] * mat.shape[2]]))
+    stream.reset()
+    assert stream.partial() == []
+
+
+def test_stats():
+    """Decoding statistics of each batch element, only available if the module is built with WBS_STATS=1."""
+    corpus = 'a ba'
+    chars = 'ab '
+    word_chars = 'ab'
+    mat = np.array([[[0.9, 0.1, 0.0, 0.0]], [[0.0, 0.0, 0.0, 1.0]], [[0.6, 0.4, 0.0, 0.0]]])
+
+    wbs = WordBeamSearch(25, 'NGramsForecast', 0.0, corpus.encode('utf8'), chars.encode('utf8'), word_chars.encode('utf8'))
+    try:
+        res, stats = wbs.compute_with_stats(mat)
+    except RuntimeError:
+        pytest.skip('module built without WBS_STATS')
+
+    assert res == wbs.compute(mat)
+    assert len(stats) == 1
+    assert stats[0]['time_steps'] == 3
+    assert stats[0]['candidates'] >= stats[0]['beams_expanded'] > 0
+    assert stats[0]['lm_lookups'] > 0 and stats[0]['lm_time'] >= 0.0